@@ -0,0 +1,400 @@
+/********************************************************************
+**                                                                 **
+** File   : app/bench.cpp                                          **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "convert/CompressRstImage.h"
+#include "convert/ConvertRstImageOpenCV.h"
+#include "convert/ScaleEncodeImageOpenCV.h"
+#include "convert/ScaleImageOpenCV.h"
+#ifdef PONTOON_WITH_TURBOJPEG
+#include "convert/ConvertRstImageTurboJpeg.h"
+#endif
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <sstream>
+#include <vector>
+
+using pontoon::convert::Compression;
+using pontoon::convert::CompressRstImage;
+using pontoon::convert::DecodeRstVisionEncodedImage;
+using pontoon::convert::EncodeRstVisionImage;
+using pontoon::convert::ImageEncoding;
+using pontoon::convert::ScaleEncodeRstVisionImage;
+using pontoon::convert::ScaleImageOpenCV;
+#ifdef PONTOON_WITH_TURBOJPEG
+using pontoon::convert::DecodeRstVisionEncodedImageTurboJpeg;
+using pontoon::convert::EncodeRstVisionImageTurboJpeg;
+using pontoon::convert::TurboJpeg;
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Fixture {
+  std::string name;
+  boost::shared_ptr<cv::Mat> image;
+
+  size_t bytes() const { return image->total() * image->elemSize(); }
+};
+
+/// a gradient with some noise, so the codecs see a camera-like image
+Fixture syntheticFixture(cv::Size size, int depth, int channels) {
+  cv::Mat gradient(size, CV_8UC3);
+  for (int row = 0; row < size.height; ++row) {
+    auto pixel = gradient.ptr<cv::Vec3b>(row);
+    for (int col = 0; col < size.width; ++col) {
+      pixel[col] = cv::Vec3b(col * 255 / size.width, row * 255 / size.height,
+                             (col + row) * 127 / (size.width + size.height));
+    }
+  }
+  cv::Mat noise(size, CV_16SC3);
+  cv::randn(noise, cv::Scalar::all(0), cv::Scalar::all(8));
+  cv::add(gradient, noise, gradient, cv::noArray(), gradient.type());
+  if (channels == 1) {
+    cv::cvtColor(gradient, gradient, cv::COLOR_BGR2GRAY);
+  }
+
+  Fixture fixture;
+  fixture.image = boost::make_shared<cv::Mat>();
+  gradient.convertTo(*fixture.image, CV_MAKETYPE(depth, channels),
+                     depth == CV_16U ? 257. : 1.);
+  std::stringstream name;
+  name << size.width << "x" << size.height << "/"
+       << (depth == CV_16U ? "16U" : "8U") << "C" << channels;
+  fixture.name = name.str();
+  return fixture;
+}
+
+struct Benchmark {
+  std::string name;
+  /// returns the produced bytes, 0 when there is no meaningful ratio
+  std::function<size_t()> step;
+};
+
+class Runner {
+public:
+  Runner(double min_seconds, size_t min_iterations, bool csv)
+      : _MinTime(std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(min_seconds))),
+        _MinIterations(std::max<size_t>(1, min_iterations)), _Csv(csv) {
+    if (_Csv) {
+      std::cout << "benchmark,fixture,ns_per_frame,mb_per_s,ratio"
+                << std::endl;
+    } else {
+      std::cout << std::left << std::setw(24) << "benchmark" << std::setw(18)
+                << "fixture" << std::right << std::setw(14) << "ns/frame"
+                << std::setw(10) << "MB/s" << std::setw(8) << "ratio"
+                << std::endl;
+    }
+  }
+
+  void run(const Benchmark &benchmark, const Fixture &fixture) {
+    size_t produced = benchmark.step(); // warm up buffers and codecs
+    size_t iterations = 0;
+    const auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (iterations < _MinIterations || elapsed < _MinTime) {
+      produced = benchmark.step();
+      ++iterations;
+      elapsed = Clock::now() - start;
+    }
+    const double ns =
+        std::chrono::duration<double, std::nano>(elapsed).count() /
+        iterations;
+    const double mbps = fixture.bytes() / (ns * 1e-9) / (1 << 20);
+    const double ratio = produced / double(fixture.bytes());
+    if (_Csv) {
+      std::cout << benchmark.name << "," << fixture.name << "," << std::fixed
+                << std::setprecision(0) << ns << "," << std::setprecision(1)
+                << mbps << ",";
+      if (produced) {
+        std::cout << std::setprecision(4) << ratio;
+      }
+      std::cout << std::endl;
+    } else {
+      std::cout << std::left << std::setw(24) << benchmark.name
+                << std::setw(18) << fixture.name << std::right << std::fixed
+                << std::setprecision(0) << std::setw(14) << ns
+                << std::setprecision(1) << std::setw(10) << mbps;
+      if (produced) {
+        std::cout << std::setprecision(3) << std::setw(8) << ratio;
+      } else {
+        std::cout << std::setw(8) << "-";
+      }
+      std::cout << std::endl;
+    }
+  }
+
+private:
+  const Clock::duration _MinTime;
+  const size_t _MinIterations;
+  const bool _Csv;
+};
+
+/// all converter benchmarks that support the fixture's image type
+std::vector<Benchmark>
+benchmarksFor(const Fixture &fixture,
+              const ImageEncoding::Parameters &parameters) {
+  std::vector<Benchmark> benchmarks;
+  const auto image = fixture.image;
+
+  for (double factor : {.5, .75}) {
+    auto scale = std::make_shared<ScaleImageOpenCV>(factor, factor);
+    std::stringstream name;
+    name << "scale/" << factor;
+    benchmarks.push_back(Benchmark{name.str(), [scale, image]() {
+                                     scale->scale(image);
+                                     return size_t(0);
+                                   }});
+  }
+
+  std::vector<ImageEncoding::Type> encodings = {ImageEncoding::png};
+  if (image->depth() == CV_8U) {
+    encodings.push_back(ImageEncoding::jpg);
+  }
+  for (auto type : encodings) {
+    const std::string name = ImageEncoding::typeToString(type);
+    auto encode = std::make_shared<EncodeRstVisionImage>(type, parameters);
+    benchmarks.push_back(Benchmark{"encode/" + name, [encode, image]() {
+                                     return encode->encode(image)
+                                         ->data()
+                                         .size();
+                                   }});
+    auto encoded = encode->encode(image);
+    auto decode = std::make_shared<DecodeRstVisionEncodedImage>();
+    benchmarks.push_back(Benchmark{"decode/" + name, [decode, encoded]() {
+                                     decode->decode(encoded);
+                                     return size_t(0);
+                                   }});
+  }
+
+  if (image->depth() == CV_8U) {
+    // scaling and encoding in two steps against the fused converter
+    const double factor = .5;
+    auto scale = std::make_shared<ScaleImageOpenCV>(factor, factor);
+    auto encode =
+        std::make_shared<EncodeRstVisionImage>(ImageEncoding::jpg, parameters);
+    auto fused = std::make_shared<ScaleEncodeRstVisionImage>(
+        *scale, ImageEncoding::jpg, parameters);
+    benchmarks.push_back(
+        Benchmark{"scale-encode/jpg", [scale, encode, image]() {
+                    return encode->encode(scale->scale(image))->data().size();
+                  }});
+    benchmarks.push_back(Benchmark{"fused-scale-encode/jpg", [fused, image]() {
+                                     return fused->encode(image)
+                                         ->data()
+                                         .size();
+                                   }});
+  }
+
+#ifdef PONTOON_WITH_TURBOJPEG
+  if (image->depth() == CV_8U) {
+    TurboJpeg::Parameters turbo;
+    // same default as OpenCV
+    turbo.quality = parameters.jpeg_quality >= 0 ? parameters.jpeg_quality : 95;
+    auto encode = std::make_shared<EncodeRstVisionImageTurboJpeg>(turbo);
+    benchmarks.push_back(Benchmark{"encode/jpg-turbo", [encode, image]() {
+                                     return encode->encode(image)
+                                         ->data()
+                                         .size();
+                                   }});
+    turbo.fast_dct = true;
+    auto fast = std::make_shared<EncodeRstVisionImageTurboJpeg>(turbo);
+    benchmarks.push_back(Benchmark{"encode/jpg-turbo-fast", [fast, image]() {
+                                     return fast->encode(image)->data().size();
+                                   }});
+    if (image->channels() == 3) {
+      auto yuv = std::make_shared<cv::Mat>();
+      cv::cvtColor(*image, *yuv, cv::COLOR_BGR2YUV_I420);
+      benchmarks.push_back(Benchmark{"encode/jpg-turbo-i420", [encode, yuv]() {
+                                       return encode->encodeI420(*yuv)
+                                           ->data()
+                                           .size();
+                                     }});
+    }
+    auto encoded = encode->encode(image);
+    for (int reduction : {1, 2}) {
+      auto decode =
+          std::make_shared<DecodeRstVisionEncodedImageTurboJpeg>(reduction);
+      const std::string name = reduction == 1 ? "decode/jpg-turbo"
+                                              : "decode/jpg-turbo-1/2";
+      benchmarks.push_back(Benchmark{name, [decode, encoded]() {
+                                       decode->decode(encoded);
+                                       return size_t(0);
+                                     }});
+    }
+  }
+#endif
+
+  for (auto backend : {Compression::zlib, Compression::zstd,
+                       Compression::lz4}) {
+    if (!Compression::available(backend)) {
+      continue;
+    }
+    for (auto filter : {Compression::none, Compression::paeth}) {
+      Compression::Parameters parameters;
+      parameters.backend = backend;
+      parameters.filter = filter;
+      const std::string name = Compression::backendToString(backend) + "-" +
+                               Compression::filterToString(filter);
+      auto compress = std::make_shared<CompressRstImage>(parameters);
+      benchmarks.push_back(Benchmark{"compress/" + name, [compress, image]() {
+                                       return compress->compress(*image)
+                                           ->data()
+                                           .size();
+                                     }});
+      auto compressed = compress->compress(*image);
+      auto decompress = std::make_shared<CompressRstImage>(parameters);
+      benchmarks.push_back(
+          Benchmark{"decompress/" + name, [decompress, compressed]() {
+                      decompress->decompressMat(*compressed);
+                      return size_t(0);
+                    }});
+    }
+  }
+  return benchmarks;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  boost::program_options::variables_map program_options;
+
+  std::string description =
+      "This application benchmarks the pontoon converters on synthetic "
+      "images from VGA to 4K and optional sample images. The libjpeg-turbo "
+      "converters are included when built with BUILD_WITH_TURBOJPEG. It needs "
+      "no rsb daemon.";
+  std::stringstream description_text;
+  description_text << description << "\n\n"
+                   << "Allowed options";
+  boost::program_options::options_description desc(description_text.str());
+  desc.add_options()("help,h", "produce help message");
+
+  desc.add_options()(
+      "image,i",
+      boost::program_options::value<std::vector<std::string>>()->composing(),
+      "A sample image to benchmark in addition to the synthetic ones. Can be "
+      "passed several times.");
+
+  desc.add_options()("no-synthetic", "Only benchmark the sample images.");
+
+  desc.add_options()(
+      "filter,f",
+      boost::program_options::value<std::string>()->default_value(""),
+      "Only run benchmarks whose name or fixture contains this string.");
+
+  desc.add_options()(
+      "min-time,t",
+      boost::program_options::value<double>()->default_value(.5),
+      "The minimum time in seconds to run each benchmark.");
+
+  desc.add_options()(
+      "min-iterations,n",
+      boost::program_options::value<size_t>()->default_value(3),
+      "The minimum number of frames to process per benchmark.");
+
+  desc.add_options()(
+      "jpeg-quality,q",
+      boost::program_options::value<int>()->default_value(-1),
+      "The jpeg quality from 0 to 100. -1 for the OpenCV default.");
+
+  desc.add_options()("csv", "Print comma separated values.");
+
+  ;
+
+  try {
+    boost::program_options::store(
+        boost::program_options::parse_command_line(argc, argv, desc),
+        program_options);
+    boost::program_options::notify(program_options);
+
+    if (program_options.count("help")) {
+      std::cout << desc << "\n";
+      return 1;
+    }
+
+  } catch (boost::program_options::error &e) {
+    std::cerr << "Could not parse program options: " << e.what();
+    std::cerr << "\n\n" << desc << "\n";
+    return 1;
+  }
+
+  const std::string filter = program_options["filter"].as<std::string>();
+  ImageEncoding::Parameters parameters;
+  parameters.jpeg_quality = program_options["jpeg-quality"].as<int>();
+
+  std::vector<Fixture> fixtures;
+  if (!program_options.count("no-synthetic")) {
+    const std::vector<cv::Size> sizes = {
+        {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+    for (const auto &size : sizes) {
+      for (int depth : {CV_8U, CV_16U}) {
+        for (int channels : {1, 3}) {
+          fixtures.push_back(syntheticFixture(size, depth, channels));
+        }
+      }
+    }
+  }
+  if (program_options.count("image")) {
+    for (const auto &file :
+         program_options["image"].as<std::vector<std::string>>()) {
+      Fixture fixture;
+      fixture.name = file;
+      fixture.image = boost::make_shared<cv::Mat>(
+          cv::imread(file, cv::IMREAD_UNCHANGED));
+      if (fixture.image->empty()) {
+        std::cerr << "Could not read " << file << std::endl;
+        return 2;
+      }
+      fixtures.push_back(fixture);
+    }
+  }
+
+  Runner runner(program_options["min-time"].as<double>(),
+                program_options["min-iterations"].as<size_t>(),
+                program_options.count("csv") > 0);
+  for (const auto &fixture : fixtures) {
+    std::vector<Benchmark> benchmarks;
+    try {
+      benchmarks = benchmarksFor(fixture, parameters);
+    } catch (const std::exception &e) {
+      std::cerr << "Skipping " << fixture.name << ": " << e.what()
+                << std::endl;
+    }
+    for (const auto &benchmark : benchmarks) {
+      if (!filter.empty() &&
+          benchmark.name.find(filter) == std::string::npos &&
+          fixture.name.find(filter) == std::string::npos) {
+        continue;
+      }
+      try {
+        runner.run(benchmark, fixture);
+      } catch (const std::exception &e) {
+        std::cerr << benchmark.name << " " << fixture.name
+                  << " failed: " << e.what() << std::endl;
+      }
+    }
+  }
+}
@@ -15,13 +15,20 @@
 **                                                                 **
 ********************************************************************/
 
-#include "convert/ConvertRstImageOpenCV.h"
 #include "io/rst/InformerCVImage.h"
-#include "io/rst/Listener.h"
+#include "io/rst/ListenerCVImage.h"
+#include "utils/FramePool.h"
+#include "utils/Metrics.h"
+#include <algorithm>
 #include <boost/program_options.hpp>
+#include <chrono>
 #include <mutex>
+#include <thread>
 
-typedef pontoon::io::rst::Listener<rst::vision::EncodedImage> ImageListener;
+typedef pontoon::io::rst::ListenerCVImageRstEncodedImage ImageListener;
+typedef pontoon::io::rst::ListenerCVImageRstCompressedImage
+    CompressedImageListener;
+typedef pontoon::utils::Subject<ImageListener::DataType> ImageSubject;
 typedef pontoon::io::rst::InformerCVImage ImageInformer;
 
 int main(int argc, char **argv) {
@@ -44,6 +51,22 @@ int main(int argc, char **argv) {
       boost::program_options::value<std::string>()->default_value("/video/raw"),
       "The output rsb uri to publish raw images.");
 
+  desc.add_options()(
+      "decode-threads,t",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many threads decode received encoded images concurrently. 0 "
+      "decodes on the receiving thread.");
+
+  desc.add_options()("compressed,c",
+                     "Receive losslessly compressed rst::vision::Images "
+                     "(encode-images with zlib, zstd or lz4) instead of "
+                     "rst::vision::EncodedImages. The decode threads then "
+                     "decompress the bands of each image.");
+
+  desc.add_options()("print-metrics,p",
+                     "Print decoder and frame pool metrics to std::err every "
+                     "second.");
+
   ;
 
   try {
@@ -75,19 +98,32 @@ int main(int argc, char **argv) {
 
   const std::string in_scope = program_options["input-uri"].as<std::string>();
   const std::string out_scope = program_options["output-uri"].as<std::string>();
+  const size_t threads = program_options["decode-threads"].as<size_t>();
+  const bool print_metrics = program_options.count("print-metrics") > 0;
 
   // init rsb components
-  auto in = std::make_shared<ImageListener>(in_scope);
+  ImageSubject::Ptr in;
+  if (program_options.count("compressed")) {
+    in = std::make_shared<CompressedImageListener>(
+        in_scope, std::max<size_t>(threads, 1));
+  } else {
+    in = std::make_shared<ImageListener>(in_scope, threads);
+  }
   auto out = std::make_shared<ImageInformer>(out_scope);
 
-  pontoon::convert::DecodeRstVisionEncodedImage convert;
-  auto connection =
-      in->connect([&convert, &out](ImageListener::DataType image) {
-        out->publish(convert.decode(image.data()), {image.id()});
-      });
+  auto connection = in->connect([&out](ImageSubject::DataType image) {
+    out->publish(image.data(), {image.id()},
+                 pontoon::io::rst::Trace::follow(*image.event()));
+  });
 
   std::cerr << "Ready..." << std::endl;
 
+  while (print_metrics) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    pontoon::utils::ConverterMetrics::printAll(std::cerr);
+    pontoon::utils::FramePool::shared().print(std::cerr);
+  }
+
   // deadlock
   std::mutex lock;
   lock.lock();
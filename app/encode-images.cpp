@@ -15,10 +15,15 @@
 **                                                                 **
 ********************************************************************/
 
+#include "convert/ScaleImageOpenCV.h"
 #include "io/rst/InformerCVImage.h"
 #include "io/rst/ListenerCVImage.h"
+#include "utils/FramePool.h"
+#include "utils/Metrics.h"
 #include <boost/program_options.hpp>
+#include <chrono>
 #include <mutex>
+#include <thread>
 
 typedef pontoon::io::rst::CombinedCVImageListener ImageListener;
 typedef pontoon::io::rst::EncodingImageInformer ImageInformer;
@@ -52,6 +57,37 @@ void block() {
   lock.lock();
 }
 
+void print_statistics(const ImageInformer &out) {
+  std::cerr << "Ready..." << std::endl;
+  auto last = out.statistics();
+  auto last_time = ImageInformer::Clock::now();
+  for (;;) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    auto stats = out.statistics();
+    auto now = ImageInformer::Clock::now();
+    double seconds = std::chrono::duration<double>(now - last_time).count();
+    size_t published = stats.published - last.published;
+    auto latency = stats.total_latency - last.total_latency;
+    std::cerr << "published: " << stats.published
+              << "\n       fps in: "
+              << (stats.received - last.received) / seconds
+              << "\n      fps out: " << published / seconds
+              << "\n      dropped: " << stats.dropped
+              << "\n  latency ms: "
+              << (published ? std::chrono::duration<double, std::milli>(
+                                  latency).count() / published
+                            : 0.)
+              << " (max "
+              << std::chrono::duration<double, std::milli>(stats.max_latency)
+                     .count()
+              << ")" << std::endl;
+    pontoon::utils::ConverterMetrics::printAll(std::cerr);
+    pontoon::utils::FramePool::shared().print(std::cerr);
+    last = stats;
+    last_time = now;
+  }
+}
+
 int main(int argc, char **argv) {
   boost::program_options::variables_map program_options;
 
@@ -78,8 +114,10 @@ int main(int argc, char **argv) {
       "encoding,e",
       boost::program_options::value<std::string>()->default_value("jpg"),
       "The output encoding to use. Can be on of ( none | ppm | png | jpg | jp2 "
-      "| tiff ). Is set to none, this application produces the usual "
-      "rst::vision::Image data.");
+      "| tiff | zlib | zstd | lz4 | jpg-turbo ). Is set to none, this "
+      "application produces the usual rst::vision::Image data. zlib, zstd and "
+      "lz4 produce losslessly compressed rst::vision::Image data. jpg-turbo "
+      "encodes jpegs with libjpeg-turbo if available.");
 
   desc.add_options()("scale-width,x",
                      boost::program_options::value<double>()->default_value(1.),
@@ -89,6 +127,90 @@ int main(int argc, char **argv) {
                      boost::program_options::value<double>()->default_value(1.),
                      "Scale the output image-height by the passed factor.");
 
+  desc.add_options()(
+      "width,W", boost::program_options::value<int>()->default_value(0),
+      "Scale the output images to this width. Overrides the scale factors. "
+      "If height is 0 it is chosen to keep the aspect ratio.");
+
+  desc.add_options()(
+      "height,H", boost::program_options::value<int>()->default_value(0),
+      "Scale the output images to this height. Overrides the scale factors. "
+      "If width is 0 it is chosen to keep the aspect ratio.");
+
+  desc.add_options()(
+      "interpolation",
+      boost::program_options::value<std::string>()->default_value("auto"),
+      "The scaling interpolation. Can be one of ( auto | nearest | linear | "
+      "area | cubic ). auto uses area for downscaling and linear for "
+      "upscaling.");
+
+  desc.add_options()(
+      "jpeg-quality,q",
+      boost::program_options::value<int>()->default_value(-1),
+      "The jpeg quality from 0 to 100. -1 for the OpenCV default.");
+
+  desc.add_options()("jpeg-progressive", "Write progressive jpegs.");
+
+  desc.add_options()("jpeg-optimize", "Optimize jpeg huffman tables.");
+
+  desc.add_options()("jpeg-fast-dct",
+                     "Use the faster, less accurate DCT with jpg-turbo.");
+
+  desc.add_options()(
+      "jpeg-subsampling",
+      boost::program_options::value<std::string>()->default_value("420"),
+      "The chroma subsampling of jpg-turbo. Can be one of "
+      "( 444 | 422 | 420 | gray ).");
+
+  desc.add_options()(
+      "png-compression,c",
+      boost::program_options::value<int>()->default_value(-1),
+      "The png compression level from 0 to 9. -1 for the OpenCV default.");
+
+  desc.add_options()(
+      "compression-level",
+      boost::program_options::value<int>()->default_value(1),
+      "The level of the zlib, zstd and lz4 encodings.");
+
+  desc.add_options()(
+      "compression-filter",
+      boost::program_options::value<std::string>()->default_value("none"),
+      "The prediction filter of the zlib, zstd and lz4 encodings. Can be one "
+      "of ( none | sub | up | paeth ).");
+
+  desc.add_options()(
+      "compression-bands",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many bands of rows the zlib, zstd and lz4 encodings compress "
+      "independently. 0 for one per compression thread.");
+
+  desc.add_options()(
+      "compression-threads",
+      boost::program_options::value<size_t>()->default_value(1),
+      "How many threads compress the bands of a frame.");
+
+  desc.add_options()(
+      "compression-keyframe-interval",
+      boost::program_options::value<size_t>()->default_value(0),
+      "Compress only every n-th frame on its own and store the others as XOR "
+      "with their predecessor. Much smaller for mostly static scenes. 0 "
+      "compresses every frame on its own.");
+
+  desc.add_options()(
+      "encode-threads,t",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many threads scale and encode images concurrently. Images are "
+      "still published in order. 0 encodes on the receiving thread.");
+
+  desc.add_options()(
+      "max-in-flight,m",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many images may be encoded at the same time before new ones are "
+      "dropped. 0 for two per encode thread.");
+
+  desc.add_options()("print-statistics,p",
+                     "Print throughput and latency to std::err.");
+
   desc.add_options()("skip-frames,s",
                      boost::program_options::value<double>()->default_value(0.),
                      "The rate of received images to be ignored. Can be used "
@@ -128,19 +250,59 @@ int main(int argc, char **argv) {
   const std::string encoding = program_options["encoding"].as<std::string>();
   const double scale_width = program_options["scale-width"].as<double>();
   const double scale_height = program_options["scale-height"].as<double>();
+  const int width = program_options["width"].as<int>();
+  const int height = program_options["height"].as<int>();
   const double skip_frames = program_options["skip-frames"].as<double>();
+  const size_t threads = program_options["encode-threads"].as<size_t>();
+  const size_t in_flight = program_options["max-in-flight"].as<size_t>();
+  const bool print_stats = program_options.count("print-statistics") > 0;
+  pontoon::convert::ImageEncoding::Parameters parameters;
+  parameters.jpeg_quality = program_options["jpeg-quality"].as<int>();
+  parameters.jpeg_progressive = program_options.count("jpeg-progressive") > 0;
+  parameters.jpeg_optimize = program_options.count("jpeg-optimize") > 0;
+  parameters.jpeg_fast_dct = program_options.count("jpeg-fast-dct") > 0;
+  parameters.jpeg_subsampling =
+      program_options["jpeg-subsampling"].as<std::string>();
+  parameters.png_compression = program_options["png-compression"].as<int>();
+  parameters.compression.level = program_options["compression-level"].as<int>();
+  parameters.compression.filter = pontoon::convert::Compression::stringToFilter(
+      program_options["compression-filter"].as<std::string>());
+  parameters.compression.bands =
+      program_options["compression-bands"].as<size_t>();
+  parameters.compression.threads =
+      program_options["compression-threads"].as<size_t>();
+  parameters.compression.keyframe_interval =
+      program_options["compression-keyframe-interval"].as<size_t>();
 
   if (scale_height <= 0 || scale_width <= 0) {
     std::cerr << "Cannot scale images with a factor of 0 or less.";
     return 1;
   }
+  if (width < 0 || height < 0) {
+    std::cerr << "Cannot scale images to a negative size.";
+    return 1;
+  }
+
+  using pontoon::convert::ScaleImageOpenCV;
+  const auto interpolation = ScaleImageOpenCV::stringToInterpolation(
+      program_options["interpolation"].as<std::string>());
+  const ScaleImageOpenCV scale =
+      (width > 0 || height > 0)
+          ? ScaleImageOpenCV(cv::Size(width, height), interpolation)
+          : ScaleImageOpenCV(scale_width, scale_height, interpolation);
 
   auto in = std::make_shared<SkippingSubject<ImageListener::DataType>>(
       std::make_shared<ImageListener>(in_scope), skip_frames);
 
-  ImageInformer out(out_scope, encoding, scale_width, scale_height);
+  ImageInformer out(out_scope, encoding, scale, threads, in_flight,
+                    parameters);
   auto connection = in->connect([&out](ImageListener::DataType data) {
-    out.publish(data.data(), {data.id()});
+    out.publish(data.data(), {data.id()},
+                pontoon::io::rst::Trace::follow(*data.event()));
   });
-  block();
+  if (print_stats) {
+    print_statistics(out);
+  } else {
+    block();
+  }
 }
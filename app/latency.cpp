@@ -0,0 +1,230 @@
+/********************************************************************
+**                                                                 **
+** File   : app/latency.cpp                                        **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/rst/ListenerCVImage.h"
+#include "io/rst/Trace.h"
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef pontoon::io::rst::CombinedCVImageListener ImageListener;
+typedef pontoon::io::rst::ListenerCVImageRstCompressedImage
+    CompressedImageListener;
+typedef pontoon::utils::Subject<ImageListener::DataType> ImageSubject;
+using pontoon::io::rst::Trace;
+
+/// the time from the previous stamp to a stamp, in microseconds
+class Latencies {
+public:
+  typedef std::pair<size_t, Trace::Stage> Step;
+  typedef std::map<Step, std::vector<int64_t>> Samples;
+
+  void add(const std::vector<Trace::Stamp> &stamps) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 1; i < stamps.size(); ++i) {
+      _samples[Step(stamps[i].hop, stamps[i].stage)].push_back(
+          int64_t(stamps[i].time) - int64_t(stamps[i - 1].time));
+    }
+    if (!stamps.empty()) {
+      _total.push_back(int64_t(stamps.back().time) -
+                       int64_t(stamps.front().time));
+    }
+  }
+
+  /// returns and resets the samples since the last call
+  void take(Samples &samples, std::vector<int64_t> &total) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    samples.clear();
+    total.clear();
+    std::swap(samples, _samples);
+    std::swap(total, _total);
+  }
+
+private:
+  std::mutex _mutex;
+  Samples _samples;
+  std::vector<int64_t> _total;
+};
+
+/// nearest rank percentile of sorted samples
+int64_t percentile(const std::vector<int64_t> &sorted, double p) {
+  size_t rank = size_t(std::ceil(p * sorted.size()));
+  return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+double ms(int64_t us) { return us / 1000.; }
+
+/// log2 buckets of microseconds, negative values come from unsynced clocks
+void print_histogram(const std::vector<int64_t> &sorted, std::ostream &out) {
+  std::map<int, size_t> buckets;
+  for (auto sample : sorted) {
+    int bucket = sample <= 0 ? -1 : int(std::log2(double(sample)));
+    ++buckets[bucket];
+  }
+  for (const auto &bucket : buckets) {
+    std::stringstream range;
+    if (bucket.first < 0) {
+      range << "<= 0";
+    } else {
+      range << "< " << ms(int64_t(1) << (bucket.first + 1)) << "ms";
+    }
+    out << "    " << std::setw(12) << range.str() << " "
+        << std::setw(7) << bucket.second << " "
+        << std::string(std::max<size_t>(1, 50 * bucket.second /
+                                               sorted.size()),
+                       '#')
+        << "\n";
+  }
+}
+
+void print_row(const std::string &name, std::vector<int64_t> &samples,
+               bool histogram, std::ostream &out) {
+  if (samples.empty()) {
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  out << std::setw(20) << name << std::setw(8) << samples.size()
+      << std::setw(10) << ms(percentile(samples, 0.5)) << std::setw(10)
+      << ms(percentile(samples, 0.9)) << std::setw(10)
+      << ms(percentile(samples, 0.99)) << std::setw(10) << ms(samples.back())
+      << "\n";
+  if (histogram) {
+    print_histogram(samples, out);
+  }
+}
+
+int main(int argc, char **argv) {
+  boost::program_options::variables_map program_options;
+
+  std::string description =
+      "This application listens for images and reports the latency between "
+      "the trace stamps (see pontoon::io::rst::Trace) of their events. Every "
+      "row is the time from the previous stamp to the named stamp, rows are "
+      "named <hop>.<stage> where hop 0 is the first publisher. Stamps of "
+      "different hosts need synchronized clocks.";
+  std::stringstream description_text;
+  description_text << description << "\n\n"
+                   << "Allowed options";
+  boost::program_options::options_description desc(description_text.str());
+  desc.add_options()("help,h", "produce help message");
+
+  desc.add_options()("input-uri,i", boost::program_options::value<std::string>()
+                                        ->default_value("/video/encoded"),
+                     "The input rsb uri to receive raw or encoded images.");
+
+  desc.add_options()(
+      "decode-threads,t",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many threads decode received encoded images concurrently. 0 "
+      "decodes on the receiving thread.");
+
+  desc.add_options()("compressed,c",
+                     "Receive losslessly compressed rst::vision::Images "
+                     "(encode-images with zlib, zstd or lz4) instead of "
+                     "raw or encoded images.");
+
+  desc.add_options()(
+      "interval,n", boost::program_options::value<double>()->default_value(5.),
+      "Seconds between reports, each covering the images of its interval.");
+
+  desc.add_options()("histogram,g",
+                     "Print a histogram of every row in log2 buckets.");
+
+  ;
+
+  try {
+    boost::program_options::store(
+        boost::program_options::parse_command_line(argc, argv, desc),
+        program_options);
+    boost::program_options::notify(program_options);
+
+    std::stringstream arguments;
+    for (int i = 0; i < argc; ++i) {
+      arguments << argv[i] << " ";
+    }
+    std::cerr << "Program started with line: " << arguments.str() << std::endl;
+
+    if (program_options.count("help")) {
+      std::cout << desc << "\n";
+      return 1;
+    }
+
+  } catch (boost::program_options::error &e) {
+    std::stringstream arguments;
+    for (int i = 0; i < argc; ++i) {
+      arguments << argv[i] << " ";
+    }
+    std::cerr << "Could not parse program options: " << e.what();
+    std::cerr << "\n\n" << desc << "\n";
+    return 1;
+  }
+
+  const std::string in_scope = program_options["input-uri"].as<std::string>();
+  const size_t threads = program_options["decode-threads"].as<size_t>();
+  const double interval = program_options["interval"].as<double>();
+  const bool histogram = program_options.count("histogram") > 0;
+
+  if (interval <= 0) {
+    std::cerr << "The report interval needs to be positive." << std::endl;
+    return 1;
+  }
+
+  ImageSubject::Ptr in;
+  if (program_options.count("compressed")) {
+    in = std::make_shared<CompressedImageListener>(
+        in_scope, std::max<size_t>(threads, 1));
+  } else {
+    in = std::make_shared<ImageListener>(in_scope, threads);
+  }
+
+  Latencies latencies;
+  auto connection = in->connect([&latencies](ImageSubject::DataType image) {
+    Trace::stamp(*image.event(), Trace::consumed);
+    latencies.add(Trace::stamps(*image.event()));
+  });
+
+  std::cerr << "Ready..." << std::endl;
+
+  Latencies::Samples samples;
+  std::vector<int64_t> total;
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    latencies.take(samples, total);
+    std::stringstream report;
+    report << std::fixed << std::setprecision(2) << "\n"
+           << std::setw(20) << "stage [ms]" << std::setw(8) << "count"
+           << std::setw(10) << "p50" << std::setw(10) << "p90"
+           << std::setw(10) << "p99" << std::setw(10) << "max"
+           << "\n";
+    for (auto &step : samples) {
+      print_row(std::to_string(step.first.first) + "." +
+                    Trace::stageToString(step.first.second),
+                step.second, histogram, report);
+    }
+    print_row("total", total, histogram, report);
+    if (total.empty()) {
+      report << "no images received\n";
+    }
+    std::cout << report.str() << std::flush;
+  }
+}
@@ -0,0 +1,151 @@
+/********************************************************************
+**                                                                 **
+** File   : app/pipeline.cpp                                       **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/Pipeline.h"
+#include "utils/FramePool.h"
+#include "utils/Metrics.h"
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
+using pontoon::io::Pipeline;
+
+void print_statistics(const Pipeline &pipeline) {
+  std::stringstream out;
+  out << "\n";
+  for (const auto &element : pipeline.statistics()) {
+    out << std::setw(10) << element.element << " processed: " << std::setw(8)
+        << element.processed << " dropped: " << std::setw(8) << element.dropped
+        << "\n";
+  }
+  std::cerr << out.str();
+}
+
+int main(int argc, char **argv) {
+  boost::program_options::variables_map program_options;
+
+  std::string description =
+      "This application runs a pipeline of image processing elements in one "
+      "process, so its stages pass images without publishing and decoding "
+      "them in between. Elements are separated by '|' or newlines, each is a "
+      "name followed by key=value options, e.g.\n\n"
+      "  listen uri=/video/encoded threads=2 | scale width=640 |\n"
+      "  crop x=0 y=0 width=640 height=360 |\n"
+      "  publish uri=/video/crop encoding=jpg threads=2\n\n"
+      "Elements:\n"
+      "  listen uri= [threads=0] [reduction=1] [compressed=false]\n"
+      "  scale [scale-width=1] [scale-height=1] [width=0] [height=0] "
+      "[interpolation=auto]\n"
+      "  crop x= y= width= height=\n"
+      "  publish uri= [encoding=none] [threads=0] [in-flight=0] "
+      "[jpeg-quality=-1] [png-compression=-1] [compression-level=1]\n\n"
+      "Every element after listen runs on its own thread and accepts "
+      "queue=2 and overflow=drop-oldest for its input queue.";
+  std::stringstream description_text;
+  description_text << description << "\n\n"
+                   << "Allowed options";
+  boost::program_options::options_description desc(description_text.str());
+  desc.add_options()("help,h", "produce help message");
+
+  desc.add_options()("pipeline,p",
+                     boost::program_options::value<std::string>(),
+                     "The pipeline description.");
+
+  desc.add_options()("file,f", boost::program_options::value<std::string>(),
+                     "Read the pipeline description from this file, '#' "
+                     "starts a comment.");
+
+  desc.add_options()("print-statistics,s",
+                     "Print the frames processed and dropped per element, "
+                     "converter and frame pool metrics to std::err every "
+                     "second.");
+
+  ;
+
+  try {
+    boost::program_options::store(
+        boost::program_options::parse_command_line(argc, argv, desc),
+        program_options);
+    boost::program_options::notify(program_options);
+
+    std::stringstream arguments;
+    for (int i = 0; i < argc; ++i) {
+      arguments << argv[i] << " ";
+    }
+    std::cerr << "Program started with line: " << arguments.str() << std::endl;
+
+    if (program_options.count("help")) {
+      std::cout << desc << "\n";
+      return 1;
+    }
+
+    if (program_options.count("pipeline") == program_options.count("file")) {
+      throw boost::program_options::error(
+          "pass either a pipeline or a pipeline file");
+    }
+
+  } catch (boost::program_options::error &e) {
+    std::stringstream arguments;
+    for (int i = 0; i < argc; ++i) {
+      arguments << argv[i] << " ";
+    }
+    std::cerr << "Could not parse program options: " << e.what();
+    std::cerr << "\n\n" << desc << "\n";
+    return 1;
+  }
+
+  std::string description_string;
+  if (program_options.count("file")) {
+    std::ifstream file(program_options["file"].as<std::string>());
+    if (!file) {
+      std::cerr << "Cannot read the pipeline file "
+                << program_options["file"].as<std::string>() << std::endl;
+      return 1;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    description_string = content.str();
+  } else {
+    description_string = program_options["pipeline"].as<std::string>();
+  }
+  const bool print_stats = program_options.count("print-statistics") > 0;
+
+  std::unique_ptr<Pipeline> pipeline;
+  try {
+    pipeline.reset(new Pipeline(Pipeline::parse(description_string)));
+  } catch (const std::exception &e) {
+    std::cerr << "Cannot create the pipeline: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::cerr << "Ready..." << std::endl;
+
+  while (print_stats) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    print_statistics(*pipeline);
+    pontoon::utils::ConverterMetrics::printAll(std::cerr);
+    pontoon::utils::FramePool::shared().print(std::cerr);
+  }
+
+  // deadlock
+  std::mutex lock;
+  lock.lock();
+  lock.lock();
+}
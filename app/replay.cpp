@@ -0,0 +1,410 @@
+/********************************************************************
+**                                                                 **
+** File   : app/replay.cpp                                         **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/Recording.h"
+#include "io/rst/InformerCVImage.h"
+#include "utils/Exception.h"
+#include "utils/FramePool.h"
+#include "utils/SynchronizedQueue.h"
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using pontoon::io::RecordingReader;
+using pontoon::io::rst::EncodingImageInformer;
+using Clock = std::chrono::steady_clock;
+
+/// frames and their timestamps in microseconds
+class FrameSource {
+public:
+  virtual ~FrameSource() = default;
+
+  virtual size_t size() const = 0;
+  virtual uint64_t timestamp(size_t index) const = 0;
+  /// a view into the mapped file
+  virtual cv::Mat image(size_t index) const = 0;
+  virtual void prefetch(size_t index, size_t count) const = 0;
+};
+
+class RecordingSource : public FrameSource {
+private:
+  RecordingReader reader;
+
+public:
+  RecordingSource(const std::string &file_name) : reader(file_name) {
+    if (!reader.indexed()) {
+      std::cerr << "WARNING: " << file_name
+                << " has no index, it was probably not closed properly."
+                << std::endl;
+    }
+  }
+
+  size_t size() const override { return reader.size(); }
+
+  uint64_t timestamp(size_t index) const override {
+    return reader.timestamp(index);
+  }
+
+  cv::Mat image(size_t index) const override {
+    return reader.frame(index).image;
+  }
+
+  void prefetch(size_t index, size_t count) const override {
+    reader.prefetch(index, count);
+  }
+};
+
+/**
+ * Concatenated frames of one size and type as written by write-images-raw
+ * --format raw, with the timecode file written next to them or a fixed
+ * frame rate.
+ */
+class RawSource : public FrameSource {
+private:
+  const unsigned char *data = nullptr;
+  size_t file_size = 0;
+  size_t frame_size;
+  cv::Size frame_geometry;
+  int frame_type;
+  std::vector<uint64_t> timestamps;
+
+public:
+  RawSource(const std::string &file_name, const std::string &timestamp_file,
+            cv::Size size, int type, double fps)
+      : frame_size(size_t(size.area()) * CV_ELEM_SIZE(type)),
+        frame_geometry(size), frame_type(type) {
+    if (frame_size == 0) {
+      throw pontoon::utils::Exception(
+          "Raw files need a width and height greater than 0.");
+    }
+    const int file = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (file < 0 || ::fstat(file, &status) != 0) {
+      throw pontoon::utils::Exception("Could not open " + file_name);
+    }
+    file_size = status.st_size;
+    const size_t frames = file_size / frame_size;
+    if (frames > 0) {
+      void *mapped =
+          ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, file, 0);
+      if (mapped == MAP_FAILED) {
+        ::close(file);
+        throw pontoon::utils::Exception("Could not map " + file_name);
+      }
+      data = static_cast<const unsigned char *>(mapped);
+    }
+    ::close(file);
+
+    if (!timestamp_file.empty()) {
+      read_timestamps(timestamp_file, frames);
+    } else {
+      for (size_t i = 0; i < frames; ++i) {
+        timestamps.push_back(uint64_t(i * 1e6 / fps));
+      }
+    }
+  }
+
+  ~RawSource() {
+    if (data) {
+      ::munmap(const_cast<unsigned char *>(data), file_size);
+    }
+  }
+
+  size_t size() const override { return timestamps.size(); }
+
+  uint64_t timestamp(size_t index) const override {
+    return timestamps.at(index);
+  }
+
+  cv::Mat image(size_t index) const override {
+    // the mapping is read-only, the pixels must not be written
+    return cv::Mat(frame_geometry, frame_type,
+                   const_cast<unsigned char *>(data) + index * frame_size);
+  }
+
+  void prefetch(size_t index, size_t count) const override {
+    const size_t page = ::sysconf(_SC_PAGESIZE);
+    const size_t begin = index * frame_size / page * page;
+    const size_t end = std::min(file_size, (index + count) * frame_size);
+    if (begin < end) {
+      ::madvise(const_cast<unsigned char *>(data) + begin, end - begin,
+                MADV_WILLNEED);
+    }
+  }
+
+private:
+  void read_timestamps(const std::string &file_name, size_t frames) {
+    std::ifstream in(file_name);
+    if (!in.is_open()) {
+      throw pontoon::utils::Exception("Could not open " + file_name);
+    }
+    std::string line;
+    while (timestamps.size() < frames && std::getline(in, line)) {
+      // the first column holds seconds, the header line starts with "clock"
+      std::istringstream columns(line);
+      double seconds;
+      if (columns >> seconds) {
+        timestamps.push_back(uint64_t(seconds * 1e6 + .5));
+      }
+    }
+    if (timestamps.size() < frames) {
+      std::cerr << "WARNING: " << file_name << " only has timestamps for "
+                << timestamps.size() << " of " << frames << " frames."
+                << std::endl;
+    }
+  }
+};
+
+int parse_type(const std::string &type) {
+  const size_t c = type.find('C');
+  if (c == std::string::npos) {
+    throw pontoon::utils::Exception("Unknown image type: " + type);
+  }
+  const std::string depth = type.substr(0, c);
+  const int channels = std::stoi(type.substr(c + 1));
+  if (channels < 1 || channels > 4) {
+    throw pontoon::utils::Exception("Unknown image type: " + type);
+  }
+  if (depth == "8U") {
+    return CV_MAKETYPE(CV_8U, channels);
+  } else if (depth == "16U") {
+    return CV_MAKETYPE(CV_16U, channels);
+  } else if (depth == "32F") {
+    return CV_MAKETYPE(CV_32F, channels);
+  }
+  throw pontoon::utils::Exception("Unknown image type: " + type);
+}
+
+struct Frame {
+  boost::shared_ptr<cv::Mat> image;
+  uint64_t timestamp = 0;
+  /// the first frame of a pass through the recording
+  bool first = false;
+};
+
+using FrameQueue = pontoon::utils::SynchronizedQueue<Frame>;
+
+/// copies frames into pooled buffers ahead of their publishing time
+void read_ahead(const FrameSource &source, FrameQueue &queue, size_t ahead,
+                bool loop) {
+  try {
+    do {
+      for (size_t i = 0; i < source.size(); ++i) {
+        source.prefetch(i + 1, ahead);
+        const cv::Mat view = source.image(i);
+        Frame frame;
+        frame.image = pontoon::utils::FramePool::shared().create(
+            view.size(), view.type());
+        view.copyTo(*frame.image);
+        frame.timestamp = source.timestamp(i);
+        frame.first = i == 0;
+        queue.push(std::move(frame));
+      }
+    } while (loop);
+  } catch (const std::exception &e) {
+    std::cerr << "Stopping replay: " << e.what() << std::endl;
+  }
+  queue.close();
+}
+
+int main(int argc, char **argv) {
+  boost::program_options::variables_map program_options;
+
+  std::string description =
+      "This application publishes the frames of a recording written by "
+      "write-images-raw via rsb, keeping their original timing or at a "
+      "scaled rate.";
+  std::stringstream description_text;
+  description_text << description << "\n\n"
+                   << "Allowed options";
+  boost::program_options::options_description desc(description_text.str());
+  desc.add_options()("help,h", "produce help message");
+
+  desc.add_options()(
+      "input-file,i", boost::program_options::value<std::string>(),
+      "The recording or raw file to replay.");
+
+  desc.add_options()(
+      "timestamp-file,t",
+      boost::program_options::value<std::string>()->default_value(""),
+      "The timestamp file of a raw file. Recordings carry their own "
+      "timestamps.");
+
+  desc.add_options()("width", boost::program_options::value<int>(),
+                     "The image width of a raw file.");
+
+  desc.add_options()("height", boost::program_options::value<int>(),
+                     "The image height of a raw file.");
+
+  desc.add_options()(
+      "type",
+      boost::program_options::value<std::string>()->default_value("8UC3"),
+      "The image type of a raw file, e.g. 8UC1, 8UC3 or 16UC1.");
+
+  desc.add_options()(
+      "fps", boost::program_options::value<double>()->default_value(30.),
+      "The frame rate of a raw file without timestamp file.");
+
+  desc.add_options()(
+      "output-uri,o",
+      boost::program_options::value<std::string>()->default_value(
+          "/video/raw"),
+      "The output rsb uri to publish images.");
+
+  desc.add_options()(
+      "encoding,e",
+      boost::program_options::value<std::string>()->default_value("none"),
+      "The output encoding, see encode-images. none publishes "
+      "rst::vision::Images.");
+
+  desc.add_options()(
+      "encode-threads",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many threads encode images concurrently.");
+
+  desc.add_options()(
+      "rate,r", boost::program_options::value<double>()->default_value(1.),
+      "The replay speed relative to the recording. 2 plays twice as fast, "
+      "0 as fast as possible.");
+
+  desc.add_options()("loop,l", "Start over at the end of the recording.");
+
+  desc.add_options()(
+      "prefetch",
+      boost::program_options::value<size_t>()->default_value(8),
+      "How many frames the reader thread loads ahead.");
+
+  desc.add_options()("print-statistics,p", "Print statistics to std::err.");
+
+  ;
+
+  try {
+    boost::program_options::store(
+        boost::program_options::parse_command_line(argc, argv, desc),
+        program_options);
+    boost::program_options::notify(program_options);
+
+    if (program_options.count("help") || !program_options.count("input-file")) {
+      std::cout << desc << "\n";
+      return 1;
+    }
+
+  } catch (boost::program_options::error &e) {
+    std::cerr << "Could not parse program options: " << e.what();
+    std::cerr << "\n\n" << desc << "\n";
+    return 1;
+  }
+
+  const std::string input = program_options["input-file"].as<std::string>();
+  const std::string timestamps =
+      program_options["timestamp-file"].as<std::string>();
+  const std::string out_uri = program_options["output-uri"].as<std::string>();
+  const std::string encoding = program_options["encoding"].as<std::string>();
+  const size_t encode_threads =
+      program_options["encode-threads"].as<size_t>();
+  const double rate = program_options["rate"].as<double>();
+  const bool loop = program_options.count("loop") > 0;
+  const size_t ahead =
+      std::max<size_t>(1, program_options["prefetch"].as<size_t>());
+  const bool print_stats = program_options.count("print-statistics") > 0;
+
+  if (rate < 0) {
+    std::cerr << "The rate can not be negative." << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<FrameSource> source;
+  try {
+    if (program_options.count("width") || program_options.count("height")) {
+      if (!program_options.count("width") ||
+          !program_options.count("height")) {
+        std::cerr << "Raw files need --width and --height." << std::endl;
+        return 1;
+      }
+      source.reset(new RawSource(
+          input, timestamps,
+          cv::Size(program_options["width"].as<int>(),
+                   program_options["height"].as<int>()),
+          parse_type(program_options["type"].as<std::string>()),
+          program_options["fps"].as<double>()));
+    } else {
+      source.reset(new RecordingSource(input));
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+  if (source->size() == 0) {
+    std::cerr << input << " holds no frames." << std::endl;
+    return 2;
+  }
+  std::cerr << "Replaying " << source->size() << " frames." << std::endl;
+
+  EncodingImageInformer informer(out_uri, encoding, 1., 1., encode_threads);
+  FrameQueue queue(ahead, pontoon::utils::OverflowPolicy::block_producer);
+  std::thread reader(read_ahead, std::cref(*source), std::ref(queue), ahead,
+                     loop);
+
+  Clock::time_point start;
+  uint64_t start_timestamp = 0;
+  Clock::duration max_lag = Clock::duration::zero();
+  size_t published = 0;
+  auto batch_start = Clock::now();
+  Frame frame;
+  while (queue.pop(frame)) {
+    if (frame.first) {
+      start = Clock::now();
+      start_timestamp = frame.timestamp;
+    }
+    if (rate > 0) {
+      // timestamps of frames from several sources may step back a little
+      const auto offset = std::chrono::duration<double, std::micro>(
+          int64_t(frame.timestamp - start_timestamp) / rate);
+      const auto due =
+          start + std::chrono::duration_cast<Clock::duration>(offset);
+      const auto now = Clock::now();
+      if (due > now) {
+        std::this_thread::sleep_until(due);
+      } else {
+        max_lag = std::max(max_lag, now - due);
+      }
+    }
+    informer.publish(frame.image, pontoon::io::Causes());
+    if (++published % 100 == 0 && print_stats) {
+      const auto now = Clock::now();
+      std::cerr << "frames: " << published << "\tfps: "
+                << 100. / std::chrono::duration<double>(now - batch_start)
+                              .count()
+                << "\tmax lag: "
+                << std::chrono::duration<double, std::milli>(max_lag).count()
+                << "ms" << std::endl;
+      batch_start = now;
+      max_lag = Clock::duration::zero();
+    }
+  }
+  reader.join();
+  std::cerr << "Replayed " << published << " frames." << std::endl;
+}
@@ -230,6 +230,12 @@ int main(int argc, char **argv) {
                      boost::program_options::value<double>()->default_value(30),
                      "The maximum amount of frames to show per second");
 
+  desc.add_options()(
+      "reduce,r", boost::program_options::value<int>()->default_value(1),
+      "Shrink encoded background images by this factor while decoding. Can "
+      "be one of ( 1 | 2 | 4 | 8 ). Jpegs are decoded directly at the "
+      "reduced size.");
+
   try {
     boost::program_options::store(
         boost::program_options::parse_command_line(argc, argv, desc),
@@ -260,8 +266,9 @@ int main(int argc, char **argv) {
   auto image_uri = program_options["background-uri"].as<std::string>();
   auto face_uri = program_options["faces-uri"].as<std::string>();
   auto patch_uri = program_options["patches-uri"].as<std::string>();
+  auto reduction = program_options["reduce"].as<int>();
 
-  ImageListener image_listener(image_uri);
+  ImageListener image_listener(image_uri, 0, reduction);
   FaceAndPatchListener face_patches_listener(face_uri, patch_uri);
 
   std::mutex mutex;
@@ -31,10 +31,12 @@ using pontoon::utils::FpsLimiter;
 
 class CollectImages {
 public:
-  CollectImages(std::vector<ImageListener::Ptr> listeners)
+  CollectImages(std::vector<ImageListener::Ptr> listeners, size_t queue_size,
+                pontoon::utils::OverflowPolicy::Type overflow)
       : _listeners(listeners) {
     for (size_t i = 0; i < listeners.size(); ++i) {
-      _queues.push_back(std::unique_ptr<ImageQueue>(new ImageQueue(1)));
+      _queues.push_back(
+          std::unique_ptr<ImageQueue>(new ImageQueue(queue_size, overflow)));
       _connections.push_back(listeners[i]->connect([this, i](
           ImageListener::DataType image) { this->_queues[i]->push(image); }));
     }
@@ -83,8 +85,10 @@ private: // members
 
 public:
   CombineImages(std::vector<ImageListener::Ptr> listeners, size_t rows,
-                size_t columns)
-      : _collect(listeners), _imageUpdated(listeners.size(), false),
+                size_t columns, size_t queue_size,
+                pontoon::utils::OverflowPolicy::Type overflow)
+      : _collect(listeners, queue_size, overflow),
+        _imageUpdated(listeners.size(), false),
         _rows(rows), _columns(columns) {
     assert(size_t(_rows * _columns) >= listeners.size());
     _lastImages.resize(listeners.size());
@@ -212,6 +216,30 @@ int main(int argc, char **argv) {
                      boost::program_options::value<double>()->default_value(30),
                      "The maximum amount of frames to show per second");
 
+  desc.add_options()(
+      "max-queue-size,m",
+      boost::program_options::value<size_t>()->default_value(1),
+      "How many images to hold per input before starting to drop frames. 0 "
+      "for unlimited.");
+
+  desc.add_options()(
+      "overflow-policy,d",
+      boost::program_options::value<std::string>()->default_value(
+          "drop-oldest"),
+      "What to do with a new image when the queue is full. Can be one of ( "
+      "drop-oldest | drop-newest | block-producer ).");
+
+  desc.add_options()(
+      "decode-threads,t",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many threads decode received encoded images concurrently. 0 "
+      "decodes on the receiving thread.");
+
+  desc.add_options()(
+      "reduce", boost::program_options::value<int>()->default_value(1),
+      "Shrink encoded images by this factor while decoding. Can be one of ( "
+      "1 | 2 | 4 | 8 ). Jpegs are decoded directly at the reduced size.");
+
   try {
     boost::program_options::store(
         boost::program_options::parse_command_line(argc, argv, desc),
@@ -242,16 +270,24 @@ int main(int argc, char **argv) {
   const std::vector<std::string> in_scopes =
       program_options["input-uri"].as<std::vector<std::string>>();
 
+  const auto threads = program_options["decode-threads"].as<size_t>();
+  const auto reduction = program_options["reduce"].as<int>();
+
   std::vector<ImageListener::Ptr> listeners;
   for (auto scope : in_scopes) {
-    listeners.push_back(std::make_shared<ImageListener>(scope));
+    listeners.push_back(
+        std::make_shared<ImageListener>(scope, threads, reduction));
   }
 
   auto rows = program_options["rows"].as<size_t>();
   auto cols = program_options["cols"].as<size_t>();
   fix_grid(rows, cols, listeners.size());
 
-  CombineImages combine(listeners, rows, cols);
+  const auto queue_size = program_options["max-queue-size"].as<size_t>();
+  const auto overflow = pontoon::utils::OverflowPolicy::stringToType(
+      program_options["overflow-policy"].as<std::string>());
+
+  CombineImages combine(listeners, rows, cols, queue_size, overflow);
 
   std::string window_name("pontoon-show-images");
   cv::namedWindow(window_name, cv::WINDOW_AUTOSIZE);
@@ -15,15 +15,21 @@
 **                                                                 **
 ********************************************************************/
 
+#include "io/BlockWriter.h"
 #include "io/ImageIO.h"
+#include "io/Recording.h"
 #include "io/rst/ListenerCVImage.h"
+#include "utils/RingBuffer.h"
 #include "utils/SynchronizedQueue.h"
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/rolling_mean.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
+#include <atomic>
 #include <boost/program_options.hpp>
 #include <chrono>
+#include <csignal>
 #include <fstream>
+#include <memory>
 #include <mutex>
 #include <rsb/MetaData.h>
 #include <thread>
@@ -32,6 +38,7 @@ class CapturedFrame;
 
 using ImageListener = pontoon::io::rst::CombinedCVImageListener;
 using ImageQueue = pontoon::utils::SynchronizedQueue<CapturedFrame>;
+using LockFreeImageQueue = pontoon::utils::MpscRingBuffer<CapturedFrame>;
 using time_delta = uint64_t;
 using pontoon::io::rst::EventData;
 
@@ -41,14 +48,15 @@ private:
   size_t _frame_number;
   time_delta _start_time;
   time_delta _frame_time;
+  size_t _key;
 
 public:
   CapturedFrame() {}
 
   CapturedFrame(boost::shared_ptr<cv::Mat> data, size_t frame_number,
-                time_delta start_time, time_delta frame_time)
+                time_delta start_time, time_delta frame_time, size_t key = 0)
       : _frame(data), _frame_number(frame_number), _start_time(start_time),
-        _frame_time(frame_time) {}
+        _frame_time(frame_time), _key(key) {}
 
   bool valid() const { return _frame.get() != nullptr; }
 
@@ -63,31 +71,40 @@ public:
   time_delta frame_time() const { return _frame_time; }
 
   size_t frame_number() const { return _frame_number; }
+
+  size_t key() const { return _key; }
 };
 
 class FrameDumper {
 private:
-  std::ofstream of_video;
+  std::unique_ptr<pontoon::io::BlockWriter> video;
   std::ofstream of_timestamps;
-  size_t io_buffer_size;
+  std::unique_ptr<pontoon::io::RecordingWriter> recording;
 
 public:
   FrameDumper(const std::string &video_dst, const std::string &timestamp_dst,
-              size_t buffer_size)
-      : io_buffer_size(buffer_size) {
-    if (!video_dst.empty()) {
-      of_video.open(video_dst, std::ofstream::binary);
+              const pontoon::io::BlockWriting::Parameters &writer,
+              bool use_recording) {
+    try {
+      if (use_recording && !video_dst.empty()) {
+        recording.reset(new pontoon::io::RecordingWriter(video_dst, writer));
+      } else if (!video_dst.empty()) {
+        video.reset(new pontoon::io::BlockWriter(video_dst, writer));
+      }
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
     }
     if (!timestamp_dst.empty()) {
       of_timestamps.open(timestamp_dst);
       of_timestamps << std::fixed << "clock\t# timecode format v2" << std::endl;
     }
-    if (!of_video.is_open()) {
+    if (!video && !recording) {
       std::cerr << "WARNING: could not open video output file. will not write "
                    "image data."
                 << std::endl;
     }
-    if (!of_timestamps.is_open()) {
+    // recordings carry their own timestamps
+    if (!of_timestamps.is_open() && !recording) {
       std::cerr << "WARNING: could not open timestamps output file. will not "
                    "write timestamp data."
                 << std::endl;
@@ -95,8 +112,23 @@ public:
   }
 
   void dump_frame(const CapturedFrame &frame) {
-    if (of_video.is_open()) {
-      dump_buffered(frame.data(), of_video, frame.num_bytes(), io_buffer_size);
+    if (recording) {
+      pontoon::io::Recording::FrameInfo info;
+      info.sequence = frame.frame_number();
+      info.timestamp = frame.frame_time();
+      info.key = frame.key();
+      try {
+        recording->write(frame.image(), info);
+      } catch (const std::exception &e) {
+        std::cerr << "Skipping image: " << e.what() << std::endl;
+      }
+    }
+    if (video) {
+      try {
+        video->append(frame.data(), frame.num_bytes());
+      } catch (const std::exception &e) {
+        std::cerr << "Skipping image: " << e.what() << std::endl;
+      }
     }
     if (of_timestamps.is_open()) {
       of_timestamps << frame.frame_time() / 1e6 << '\t'
@@ -105,18 +137,14 @@ public:
     }
   }
 
-private:
-  void dump_buffered(const char *data, std::ofstream &dst, size_t data_size,
-                     size_t buffer_size) {
-    if (buffer_size > 0) {
-      for (size_t i = 0; i < data_size / buffer_size; i++) {
-        dst.write(data, buffer_size);
-        data += buffer_size;
-      }
-      dst.write(data, data_size % buffer_size);
-    } else {
-      dst.write(data, data_size);
+  pontoon::io::BlockWriting::Statistics statistics() const {
+    if (recording) {
+      return recording->statistics();
     }
+    if (video) {
+      return video->statistics();
+    }
+    return pontoon::io::BlockWriting::Statistics();
   }
 };
 
@@ -149,7 +177,8 @@ public:
         _original_fps(rolling_mean::window_size = window_size),
         _bps(rolling_mean::window_size = window_size) {}
 
-  void update(const CapturedFrame &frame) {
+  void update(const CapturedFrame &frame, size_t dropped,
+              const FrameDumper &dumper) {
     time_point now = std::chrono::high_resolution_clock::now();
     _fps((now - _timestamp).count());
     _original_fps(frame.frame_time() - _last_frame_time);
@@ -164,11 +193,101 @@ public:
                 << "\n           fps: " << std::left
                 << std::setw(6) << fps << "\n  original fps: " << std::left
                 << std::setw(6) << ofps << "\n          mbps: " << std::left
-                << std::setw(6) << bps / bytes_in_mbytes << std::endl;
+                << std::setw(6) << bps / bytes_in_mbytes
+                << "\n       dropped: " << dropped << std::endl;
+      print_disk(dumper.statistics());
     }
   }
+
+private:
+  void print_disk(const pontoon::io::BlockWriting::Statistics &disk) {
+    using seconds = std::chrono::duration<double>;
+    using milliseconds = std::chrono::duration<double, std::milli>;
+    const double elapsed = seconds(disk.elapsed).count();
+    const double writing = seconds(disk.write_time).count();
+    std::cerr << "     disk mbps: " << std::left << std::setw(6)
+              << (elapsed > 0 ? disk.bytes / elapsed / bytes_in_mbytes : 0.)
+              << "\n    write mbps: " << std::left << std::setw(6)
+              << (writing > 0 ? disk.bytes / writing / bytes_in_mbytes : 0.)
+              << "\n        stalls: " << disk.stalls << " (max "
+              << milliseconds(disk.max_stall).count() << "ms, total "
+              << milliseconds(disk.stall_time).count() << "ms)" << std::endl;
+  }
 };
 
+/// set by SIGINT and SIGTERM, record() then returns so the outputs are closed
+std::atomic<bool> interrupted(false);
+
+void interrupt(int signal) {
+  interrupted = true;
+  // a second signal terminates right away
+  std::signal(signal, SIG_DFL);
+}
+
+template <typename Queue>
+void record(ImageListener &image_listener, Queue &queue, FrameDumper &dumper,
+            bool print_stats, size_t sanity_kill_millis) {
+  bool first = true;
+  time_delta start_time = 0;
+
+  auto collect_images = image_listener.connect(
+      [&queue, &start_time, &first](ImageListener::DataType image) {
+        if (!image.valid()) {
+          return;
+        }
+        if (first) {
+          start_time = image.event()->getMetaData().getCreateTime();
+          first = false;
+        }
+        auto frame_time = image.event()->getMetaData().getCreateTime();
+        auto scope = image.event()->getScopePtr()->toString();
+        queue.emplace(image.data(), image.event()->getId().getSequenceNumber(),
+                      start_time, frame_time, std::hash<std::string>()(scope));
+      });
+
+  std::cerr << "Ready..." << std::endl;
+
+  Statistics stats;
+  std::vector<typename Queue::DataType> frames;
+  // how often the loop looks for an interrupt while no frames arrive
+  const size_t poll_millis = 100;
+  size_t idle_millis = 0;
+  while (!interrupted) {
+    // wait for one frame, then take everything that queued up meanwhile
+    frames.clear();
+    frames.emplace_back();
+    if (!queue.try_pop_for(frames.front(),
+                           std::chrono::milliseconds(poll_millis))) {
+      idle_millis += poll_millis;
+      if (sanity_kill_millis != 0 && idle_millis >= sanity_kill_millis) {
+        std::cerr << "Could not get an image for " << sanity_kill_millis
+                  << "ms. Leaving application." << std::endl;
+        break;
+      }
+      continue;
+    }
+    idle_millis = 0;
+    queue.pop_all(frames);
+    for (const auto &frame : frames) {
+      if (frame.valid()) {
+        dumper.dump_frame(frame);
+      }
+      if (print_stats) {
+        stats.update(frame, queue.dropped(), dumper);
+      }
+    }
+  }
+  image_listener.disconnect(collect_images);
+  // keep the frames that were received before the listener stopped
+  frames.clear();
+  queue.pop_all(frames);
+  for (const auto &frame : frames) {
+    if (frame.valid()) {
+      dumper.dump_frame(frame);
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   boost::program_options::variables_map program_options;
 
@@ -190,6 +309,15 @@ int main(int argc, char **argv) {
       boost::program_options::value<std::string>()->default_value(""),
       "The name of the file to dump images to.");
 
+  desc.add_options()(
+      "format,f",
+      boost::program_options::value<std::string>()->default_value("raw"),
+      "The output file format. Can be one of ( raw | recording ). raw "
+      "concatenates the pixel data of all images. recording writes a "
+      "self-describing, indexed file with size, type, timestamp and sequence "
+      "number of every image that can be replayed without a timestamp "
+      "file.");
+
   desc.add_options()(
       "timestamp-file-name,t",
       boost::program_options::value<std::string>()->default_value(""),
@@ -197,13 +325,55 @@ int main(int argc, char **argv) {
 
   desc.add_options()(
       "buffer-size-image-out,b",
-      boost::program_options::value<size_t>()->default_value(32768),
-      "The buffer size to use when writing images.");
+      boost::program_options::value<size_t>()->default_value(size_t(4) << 20),
+      "The size of the blocks images are written in. Rounded up to a multiple "
+      "of 4096.");
+
+  desc.add_options()(
+      "writer,w",
+      boost::program_options::value<std::string>()->default_value("sync"),
+      "How images are written. Can be one of ( sync | thread ). thread "
+      "writes from a dedicated I/O thread, so the writer only waits for the "
+      "disk when all blocks are in flight.");
+
+  desc.add_options()(
+      "writer-blocks",
+      boost::program_options::value<size_t>()->default_value(4),
+      "How many blocks the thread writer can have in flight.");
+
+  desc.add_options()("direct-io",
+                     "Open the output file with O_DIRECT to bypass the page "
+                     "cache.");
+
+  desc.add_options()(
+      "preallocate",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many MiB to reserve on disk for the output file. 0 for none.");
 
   desc.add_options()(
       "max-queue-size,m",
       boost::program_options::value<size_t>()->default_value(150),
-      "How many images to hold before starting to drop frames.");
+      "How many images to hold before starting to drop frames. 0 for "
+      "unlimited. Counted per scope with keep-latest-per-key.");
+
+  desc.add_options()(
+      "overflow-policy,d",
+      boost::program_options::value<std::string>()->default_value(
+          "drop-oldest"),
+      "What to do with a new image when the queue is full. Can be one of ( "
+      "drop-oldest | drop-newest | block-producer | keep-latest-per-key ).");
+
+  desc.add_options()(
+      "block-timeout",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many milliseconds a receiving thread waits for free space with "
+      "block-producer before dropping the image. 0 for no timeout.");
+
+  desc.add_options()(
+      "lock-free-queue,l",
+      "Pass frames to the writer through a lock-free ring buffer so the "
+      "receiving threads never wait for the writer. Needs a max-queue-size of "
+      "at least 2.");
 
   desc.add_options()(
       "sanity-kill,s",
@@ -211,6 +381,13 @@ int main(int argc, char **argv) {
       "Stop the application if no new images arrive for passed amount of milliseconds. 0 for never.");
 
 
+
+  desc.add_options()(
+      "decode-threads,j",
+      boost::program_options::value<size_t>()->default_value(0),
+      "How many threads decode received encoded images concurrently. 0 "
+      "decodes on the receiving thread.");
+
   desc.add_options()("print-statistics,p", "Print statistics to std::err.");
 
   ;
@@ -247,56 +424,58 @@ int main(int argc, char **argv) {
       program_options["output-file-name"].as<std::string>();
   const std::string timestamp_dst =
       program_options["timestamp-file-name"].as<std::string>();
+  const std::string format = program_options["format"].as<std::string>();
   const size_t queue_size = program_options["max-queue-size"].as<size_t>();
-  const size_t out_buffer_size =
-      program_options["buffer-size-image-out"].as<size_t>();
+  pontoon::io::BlockWriting::Parameters writer;
+  writer.block_size = program_options["buffer-size-image-out"].as<size_t>();
+  writer.blocks = program_options["writer-blocks"].as<size_t>();
+  writer.direct = program_options.count("direct-io") > 0;
+  writer.preallocate = uint64_t(program_options["preallocate"].as<size_t>())
+                       << 20;
   const bool print_stats = program_options.count("print-statistics") > 0;
   const auto sanity_kill_millis = program_options["sanity-kill"].as<size_t>();
+  const bool lock_free = program_options.count("lock-free-queue") > 0;
+  const auto decode_threads = program_options["decode-threads"].as<size_t>();
+  const auto block_timeout =
+      std::chrono::milliseconds(program_options["block-timeout"].as<size_t>());
 
-  // init components
-  std::mutex mutex;
-
-  ImageListener image_listener(in_scope);
-  ImageQueue queue(queue_size);
-
-  bool first = true;
-  time_delta start_time = 0;
-
-  auto collect_images = image_listener.connect(
-      [&queue, &start_time, &first](ImageListener::DataType image) {
-        if (!image.valid()) {
-          return;
-        }
-        if (first) {
-          start_time = image.event()->getMetaData().getCreateTime();
-          first = false;
-        }
-        auto frame_time = image.event()->getMetaData().getCreateTime();
-        queue.push(CapturedFrame(image.data(),
-                                 image.event()->getId().getSequenceNumber(),
-                                 start_time, frame_time));
-      });
+  if (format != "raw" && format != "recording") {
+    std::cerr << "Unknown output format: " << format << std::endl;
+    return 1;
+  }
 
-  std::cerr << "Ready..." << std::endl;
+  pontoon::utils::OverflowPolicy::Type overflow;
+  try {
+    overflow = pontoon::utils::OverflowPolicy::stringToType(
+        program_options["overflow-policy"].as<std::string>());
+    writer.backend = pontoon::io::BlockWriting::stringToBackend(
+        program_options["writer"].as<std::string>());
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
 
-  FrameDumper dumper(image_dst, timestamp_dst, out_buffer_size);
-  Statistics stats;
-  for (;;) {
-    ImageQueue::DataType frame;
-    if(sanity_kill_millis == 0){
-      queue.pop(frame);
-    } else {
-      bool got = queue.try_pop_for(frame, std::chrono::milliseconds(sanity_kill_millis));
-      if(!got){
-        std::cerr << "Could not get an image for " << sanity_kill_millis << "ms. Leaving application." << std::endl;
-        break;
-      }
-    }
-    if (frame.valid()) {
-      dumper.dump_frame(frame);
-    }
-    if (print_stats) {
-      stats.update(frame);
+  std::unique_ptr<LockFreeImageQueue> lock_free_queue;
+  if (lock_free) {
+    try {
+      lock_free_queue.reset(new LockFreeImageQueue(queue_size, overflow));
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
     }
   }
+
+  FrameDumper dumper(image_dst, timestamp_dst, writer, format == "recording");
+  ImageListener image_listener(in_scope, decode_threads);
+  // leave record() on Ctrl-C, so the dumper writes out its partial blocks
+  std::signal(SIGINT, interrupt);
+  std::signal(SIGTERM, interrupt);
+  if (lock_free_queue) {
+    record(image_listener, *lock_free_queue, dumper, print_stats,
+           sanity_kill_millis);
+  } else {
+    ImageQueue queue(queue_size, overflow, block_timeout,
+                     [](const CapturedFrame &frame) { return frame.key(); });
+    record(image_listener, queue, dumper, print_stats, sanity_kill_millis);
+  }
 }
@@ -49,6 +49,12 @@ int main(int argc, char **argv) {
       boost::program_options::value<std::string>()->default_value("./img_"),
       "The output file prefix");
 
+  desc.add_options()(
+      "max-queue-size,m",
+      boost::program_options::value<size_t>()->default_value(10),
+      "How many images to hold while writing before starting to drop the "
+      "oldest ones. 0 for unlimited.");
+
   ;
 
   try {
@@ -81,6 +87,7 @@ int main(int argc, char **argv) {
   const std::string in_scope = program_options["input-uri"].as<std::string>();
   const std::string encoding = program_options["encoding"].as<std::string>();
   const std::string prefix = program_options["prefix"].as<std::string>();
+  const size_t queue_size = program_options["max-queue-size"].as<size_t>();
 
   // init components
   std::mutex mutex;
@@ -89,12 +96,14 @@ int main(int argc, char **argv) {
   pontoon::io::ImageIO::FileNameGenerator fg(prefix,
                                              std::string(".") + encoding);
 
-  auto connection =
-      in->connect([&mutex, &in, &fg](ImageListener::DataType image) {
+  // write on a worker thread so slow disks do not stall event delivery
+  auto connection = in->connect_async(
+      [&mutex, &in, &fg](ImageListener::DataType image) {
         std::cout << "Image received" << std::endl;
         std::lock_guard<std::mutex> l(mutex);
         pontoon::io::ImageIO::writeImage(fg.nextFreeFilename(), *image.data());
-      });
+      },
+      queue_size);
 
   std::cerr << "Ready..." << std::endl;
 
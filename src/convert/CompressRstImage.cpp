@@ -0,0 +1,872 @@
+/********************************************************************
+**                                                                 **
+** File   : src/convert/CompressRstImage.cpp                       **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "convert/CompressRstImage.h"
+#include "utils/Exception.h"
+#include "utils/FramePool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <zlib.h>
+#ifdef PONTOON_WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef PONTOON_WITH_LZ4
+#include <lz4.h>
+#endif
+
+using pontoon::convert::Compression;
+using pontoon::convert::CompressRstImage;
+using pontoon::utils::ConverterMetrics;
+
+namespace {
+
+const char MAGIC[4] = {'P', 'N', 'T', 'Z'};
+/// version 1 has no band index and stores all data in one band
+const unsigned char VERSION = 2;
+/// version 3 adds delta streams, other frames are still written as version 2
+const unsigned char VERSION_DELTA = 3;
+const size_t HEADER_SIZE_V1 = 20;
+const size_t HEADER_SIZE = 24;
+/// raw and compressed size of a band
+const size_t BAND_INDEX_ENTRY_SIZE = 8;
+
+/// the frame is coded against the previous frame of the stream
+const unsigned char REFERENCES_PREVIOUS = 1 << 0;
+/// the frame is the reference of the next frame of the stream
+const unsigned char KEEP_AS_REFERENCE = 1 << 1;
+/**
+ * the reference is the unfiltered previous frame and frames referencing it
+ * store their XOR with it. Set on all frames of streams, frames referencing
+ * the previous one without it used it as compression dictionary, which is
+ * no longer supported.
+ */
+const unsigned char DELTA_STREAM = 1 << 2;
+
+struct Band {
+  size_t raw_offset;
+  size_t raw_size;
+  size_t data_offset;
+  size_t data_size;
+};
+
+struct Header {
+  Compression::Backend backend;
+  Compression::Filter filter;
+  unsigned char flags;
+  uint32_t sequence;
+  uint64_t raw_size;
+  std::vector<Band> bands;
+};
+
+template <typename T>
+void writeLittleEndian(unsigned char *out, T value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    out[i] = (unsigned char)(uint64_t(value) >> (8 * i));
+  }
+}
+
+uint64_t readLittleEndian(const unsigned char *in, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= uint64_t(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+size_t headerSize(size_t bands) {
+  return HEADER_SIZE + bands * BAND_INDEX_ENTRY_SIZE;
+}
+
+void writeHeader(const Header &header, unsigned char *out) {
+  std::memcpy(out, MAGIC, 4);
+  out[4] = (header.flags & DELTA_STREAM) ? VERSION_DELTA : VERSION;
+  out[5] = (unsigned char)header.backend;
+  out[6] = (unsigned char)header.filter;
+  out[7] = header.flags;
+  writeLittleEndian(out + 8, header.sequence, 4);
+  writeLittleEndian(out + 12, header.raw_size, 8);
+  writeLittleEndian(out + 20, header.bands.size(), 4);
+  out += HEADER_SIZE;
+  for (const Band &band : header.bands) {
+    writeLittleEndian(out, band.raw_size, 4);
+    writeLittleEndian(out + 4, band.data_size, 4);
+    out += BAND_INDEX_ENTRY_SIZE;
+  }
+}
+
+Header readHeader(const std::string &data) {
+  const auto *in = reinterpret_cast<const unsigned char *>(data.data());
+  if (in[4] != 1 && in[4] != VERSION && in[4] != VERSION_DELTA) {
+    throw pontoon::utils::Exception(
+        "Unsupported compressed image version " + std::to_string(in[4]));
+  }
+  if (in[5] > Compression::lz4 || in[6] > Compression::paeth) {
+    throw pontoon::utils::Exception("Corrupt compressed image header");
+  }
+  Header header;
+  header.backend = (Compression::Backend)in[5];
+  header.filter = (Compression::Filter)in[6];
+  header.flags = in[7];
+  header.sequence = readLittleEndian(in + 8, 4);
+  header.raw_size = readLittleEndian(in + 12, 8);
+  if (in[4] == 1) {
+    header.bands.push_back(Band{0, header.raw_size, HEADER_SIZE_V1,
+                                data.size() - HEADER_SIZE_V1});
+    return header;
+  }
+
+  if (data.size() < HEADER_SIZE) {
+    throw pontoon::utils::Exception("Truncated compressed image header");
+  }
+  const size_t count = readLittleEndian(in + 20, 4);
+  if (data.size() < headerSize(count)) {
+    throw pontoon::utils::Exception("Truncated compressed image band index");
+  }
+  size_t raw_offset = 0;
+  size_t data_offset = headerSize(count);
+  for (size_t i = 0; i < count; ++i) {
+    const auto *entry = in + HEADER_SIZE + i * BAND_INDEX_ENTRY_SIZE;
+    Band band{raw_offset, (size_t)readLittleEndian(entry, 4), data_offset,
+              (size_t)readLittleEndian(entry + 4, 4)};
+    raw_offset += band.raw_size;
+    data_offset += band.data_size;
+    header.bands.push_back(band);
+  }
+  if (raw_offset != header.raw_size || data_offset > data.size()) {
+    throw pontoon::utils::Exception("Corrupt compressed image band index");
+  }
+  return header;
+}
+
+void copyMetaData(const rst::vision::Image &from, rst::vision::Image &to) {
+  to.set_width(from.width());
+  to.set_height(from.height());
+  to.set_channels(from.channels());
+  to.set_depth(from.depth());
+  to.set_color_mode(from.color_mode());
+  to.set_data_order(from.data_order());
+}
+
+/// how the filters find the neighbours of an element, counted in elements
+struct Layout {
+  size_t element_size;
+  size_t distance;
+  size_t row;
+};
+
+Layout layoutOf(const rst::vision::Image &image, size_t size) {
+  const size_t width = image.width();
+  const size_t channels = std::max<size_t>(1, image.channels());
+  const size_t elements = width * image.height() * channels;
+  const size_t element_size = elements ? size / elements : 0;
+  if (!elements || size % elements != 0 ||
+      (element_size != 1 && element_size != 2 && element_size != 4 &&
+       element_size != 8)) {
+    // unknown layout, filter the bytes as a single row
+    return Layout{1, 1, std::max<size_t>(1, size)};
+  }
+  Layout layout;
+  layout.element_size = element_size;
+  if (image.data_order() == rst::vision::Image::DATA_INTERLEAVED) {
+    layout.distance = channels;
+    layout.row = width * channels;
+  } else {
+    layout.distance = 1;
+    layout.row = width;
+  }
+  if (element_size == 8) {
+    // 64 bit values are filtered as pairs of 32 bit halves
+    layout.element_size = 4;
+    layout.distance *= 2;
+    layout.row *= 2;
+  }
+  return layout;
+}
+
+/// splits size bytes into at most count bands of whole rows
+std::vector<Band> bandsOf(const Layout &layout, size_t size, size_t count) {
+  const size_t row_bytes =
+      std::max<size_t>(1, layout.row * layout.element_size);
+  const size_t rows = (size + row_bytes - 1) / row_bytes;
+  count = std::max<size_t>(1, std::min(count, rows));
+  const size_t band_bytes = (rows + count - 1) / count * row_bytes;
+  std::vector<Band> bands;
+  size_t offset = 0;
+  do {
+    const size_t band_size = std::min(band_bytes, size - offset);
+    bands.push_back(Band{offset, band_size, 0, 0});
+    offset += band_size;
+  } while (offset < size);
+  return bands;
+}
+
+rst::vision::Image metaDataOf(const cv::Mat &image) {
+  rst::vision::Image meta;
+  meta.set_width(image.cols);
+  meta.set_height(image.rows);
+  meta.set_channels(image.channels());
+  switch (image.depth()) {
+  case CV_8U:
+    meta.set_depth(rst::vision::Image::DEPTH_8U);
+    break;
+  case CV_16U:
+    meta.set_depth(rst::vision::Image::DEPTH_16U);
+    break;
+  case CV_32F:
+    meta.set_depth(rst::vision::Image::DEPTH_32F);
+    break;
+  default:
+    throw pontoon::utils::Exception(
+        "Can only compress 8U, 16U and 32F images, got cv depth " +
+        std::to_string(image.depth()));
+  }
+  if (image.channels() == 1) {
+    meta.set_color_mode(rst::vision::Image::COLOR_GRAYSCALE);
+  } else if (image.channels() == 3) {
+    meta.set_color_mode(rst::vision::Image::COLOR_BGR);
+  }
+  meta.set_data_order(rst::vision::Image::DATA_INTERLEAVED);
+  return meta;
+}
+
+int cvTypeOf(const rst::vision::Image &image) {
+  switch (image.depth()) {
+  case rst::vision::Image::DEPTH_8U:
+    return CV_MAKETYPE(CV_8U, image.channels());
+  case rst::vision::Image::DEPTH_16U:
+    return CV_MAKETYPE(CV_16U, image.channels());
+  case rst::vision::Image::DEPTH_32F:
+    return CV_MAKETYPE(CV_32F, image.channels());
+  default:
+    throw pontoon::utils::Exception(
+        "Cannot decompress images with rst depth " +
+        std::to_string(image.depth()) + " into a cv::Mat");
+  }
+}
+
+template <typename T> T load(const unsigned char *data, size_t i) {
+  T value;
+  std::memcpy(&value, data + i * sizeof(T), sizeof(T));
+  return value;
+}
+
+template <typename T> void store(unsigned char *data, size_t i, T value) {
+  std::memcpy(data + i * sizeof(T), &value, sizeof(T));
+}
+
+template <typename T> T paethPredictor(T a, T b, T c) {
+  const int64_t p = int64_t(a) + int64_t(b) - int64_t(c);
+  const int64_t pa = std::abs(p - int64_t(a));
+  const int64_t pb = std::abs(p - int64_t(b));
+  const int64_t pc = std::abs(p - int64_t(c));
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+/**
+ * out = in - prediction, or in + prediction for Inverse. Predictions are
+ * made from the unfiltered values: in when filtering and the already
+ * restored out when restoring.
+ */
+template <typename T, bool Inverse, typename Predictor>
+void predictRows(const unsigned char *in, unsigned char *out, size_t count,
+                 const Layout &layout, Predictor predict) {
+  const unsigned char *plain = Inverse ? out : in;
+  for (size_t start = 0; start < count; start += layout.row) {
+    const size_t end = std::min(count, start + layout.row);
+    for (size_t i = start; i < end; ++i) {
+      const bool left = i - start >= layout.distance;
+      const bool above = start > 0;
+      const T a = left ? load<T>(plain, i - layout.distance) : T(0);
+      const T b = above ? load<T>(plain, i - layout.row) : T(0);
+      const T c = (left && above)
+                      ? load<T>(plain, i - layout.row - layout.distance)
+                      : T(0);
+      const T prediction = predict(a, b, c);
+      const T value = load<T>(in, i);
+      store<T>(out, i, Inverse ? T(value + prediction)
+                               : T(value - prediction));
+    }
+  }
+}
+
+template <typename T, bool Inverse>
+void filterAs(Compression::Filter filter, const Layout &layout,
+              const unsigned char *in, unsigned char *out, size_t count) {
+  switch (filter) {
+  case Compression::none:
+    std::memcpy(out, in, count * sizeof(T));
+    break;
+  case Compression::sub:
+    predictRows<T, Inverse>(in, out, count, layout,
+                            [](T a, T, T) { return a; });
+    break;
+  case Compression::up:
+    predictRows<T, Inverse>(in, out, count, layout,
+                            [](T, T b, T) { return b; });
+    break;
+  case Compression::paeth:
+    predictRows<T, Inverse>(in, out, count, layout, &paethPredictor<T>);
+    break;
+  }
+}
+
+/// filters size bytes from in to out, which must not overlap
+template <bool Inverse>
+void applyFilter(Compression::Filter filter, const Layout &layout,
+                 const unsigned char *in, unsigned char *out, size_t size) {
+  const size_t count = size / layout.element_size;
+  switch (layout.element_size) {
+  case 2:
+    filterAs<uint16_t, Inverse>(filter, layout, in, out, count);
+    break;
+  case 4:
+    filterAs<uint32_t, Inverse>(filter, layout, in, out, count);
+    break;
+  default:
+    filterAs<uint8_t, Inverse>(filter, layout, in, out, count);
+  }
+  // bytes that do not fill a whole element are kept as they are
+  const size_t tail = count * layout.element_size;
+  std::memcpy(out + tail, in + tail, size - tail);
+}
+
+/// out = a ^ b, a and b may alias out
+void xorBytes(const unsigned char *a, const unsigned char *b,
+              unsigned char *out, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    out[i] = a[i] ^ b[i];
+  }
+}
+
+std::string zlibError(int code) {
+  switch (code) {
+  case Z_OK:
+    return "Ok";
+  case Z_NEED_DICT:
+    return "NeedDictionary";
+  case Z_STREAM_ERROR:
+    return "StreamError";
+  case Z_DATA_ERROR:
+    return "DataError";
+  case Z_MEM_ERROR:
+    return "MemoryError";
+  case Z_BUF_ERROR:
+    return "BufferError";
+  default:
+    return "__unknown__";
+  }
+}
+
+} // namespace
+
+/// a compression library
+class CompressRstImage::Codec {
+public:
+  Codec(Compression::Backend backend)
+      : compressed(ConverterMetrics::named(
+            "compress." + Compression::backendToString(backend))),
+        decompressed(ConverterMetrics::named(
+            "decompress." + Compression::backendToString(backend))) {}
+
+  virtual ~Codec() = default;
+
+  /// the maximum compressed size of size bytes
+  virtual size_t bound(size_t size) = 0;
+
+  /// returns the compressed size
+  virtual size_t compress(const unsigned char *in, size_t size,
+                          unsigned char *out, size_t capacity) = 0;
+
+  /// decompresses exactly raw_size bytes or throws
+  virtual void decompress(const unsigned char *in, size_t size,
+                          unsigned char *out, size_t raw_size) = 0;
+
+  ConverterMetrics &compressed;
+  ConverterMetrics &decompressed;
+};
+
+namespace {
+
+class ZlibCodec : public CompressRstImage::Codec {
+public:
+  ZlibCodec(int level) : Codec(Compression::zlib) {
+    std::memset(&_Deflate, 0, sizeof(_Deflate));
+    std::memset(&_Inflate, 0, sizeof(_Inflate));
+    int error = ::deflateInit(&_Deflate, level);
+    if (error != Z_OK) {
+      throw pontoon::utils::Exception("Could not init zlib compression. "
+                                      "Error = " +
+                                      zlibError(error));
+    }
+    error = ::inflateInit(&_Inflate);
+    if (error != Z_OK) {
+      ::deflateEnd(&_Deflate);
+      throw pontoon::utils::Exception("Could not init zlib decompression. "
+                                      "Error = " +
+                                      zlibError(error));
+    }
+  }
+
+  ~ZlibCodec() {
+    ::deflateEnd(&_Deflate);
+    ::inflateEnd(&_Inflate);
+  }
+
+  size_t bound(size_t size) override {
+    return ::deflateBound(&_Deflate, size);
+  }
+
+  size_t compress(const unsigned char *in, size_t size, unsigned char *out,
+                  size_t capacity) override {
+    ::deflateReset(&_Deflate);
+    _Deflate.next_in = const_cast<unsigned char *>(in);
+    _Deflate.avail_in = size;
+    _Deflate.next_out = out;
+    _Deflate.avail_out = capacity;
+    int error = ::deflate(&_Deflate, Z_FINISH);
+    if (error != Z_STREAM_END) {
+      throw pontoon::utils::Exception("zlib compression failed. Error = " +
+                                      zlibError(error));
+    }
+    return _Deflate.total_out;
+  }
+
+  void decompress(const unsigned char *in, size_t size, unsigned char *out,
+                  size_t raw_size) override {
+    ::inflateReset(&_Inflate);
+    _Inflate.next_in = const_cast<unsigned char *>(in);
+    _Inflate.avail_in = size;
+    _Inflate.next_out = out;
+    _Inflate.avail_out = raw_size;
+    int error = ::inflate(&_Inflate, Z_FINISH);
+    if (error != Z_STREAM_END || _Inflate.total_out != raw_size) {
+      throw pontoon::utils::Exception("zlib decompression failed. Error = " +
+                                      zlibError(error));
+    }
+  }
+
+private:
+  z_stream _Deflate;
+  z_stream _Inflate;
+};
+
+#ifdef PONTOON_WITH_ZSTD
+class ZstdCodec : public CompressRstImage::Codec {
+public:
+  ZstdCodec(int level)
+      : Codec(Compression::zstd), _Compress(ZSTD_createCCtx()),
+        _Decompress(ZSTD_createDCtx()) {
+    if (!_Compress || !_Decompress) {
+      ZSTD_freeCCtx(_Compress);
+      ZSTD_freeDCtx(_Decompress);
+      throw pontoon::utils::Exception("Could not create zstd contexts");
+    }
+    ZSTD_CCtx_setParameter(_Compress, ZSTD_c_compressionLevel, level);
+  }
+
+  ~ZstdCodec() {
+    ZSTD_freeCCtx(_Compress);
+    ZSTD_freeDCtx(_Decompress);
+  }
+
+  size_t bound(size_t size) override { return ZSTD_compressBound(size); }
+
+  size_t compress(const unsigned char *in, size_t size, unsigned char *out,
+                  size_t capacity) override {
+    size_t result = ZSTD_compress2(_Compress, out, capacity, in, size);
+    if (ZSTD_isError(result)) {
+      throw pontoon::utils::Exception(
+          std::string("zstd compression failed. Error = ") +
+          ZSTD_getErrorName(result));
+    }
+    return result;
+  }
+
+  void decompress(const unsigned char *in, size_t size, unsigned char *out,
+                  size_t raw_size) override {
+    size_t result = ZSTD_decompressDCtx(_Decompress, out, raw_size, in, size);
+    if (ZSTD_isError(result) || result != raw_size) {
+      throw pontoon::utils::Exception(
+          std::string("zstd decompression failed. Error = ") +
+          (ZSTD_isError(result) ? ZSTD_getErrorName(result) : "SizeMismatch"));
+    }
+  }
+
+private:
+  ZSTD_CCtx *_Compress;
+  ZSTD_DCtx *_Decompress;
+};
+#endif // PONTOON_WITH_ZSTD
+
+#ifdef PONTOON_WITH_LZ4
+class Lz4Codec : public CompressRstImage::Codec {
+public:
+  Lz4Codec(int level)
+      : Codec(Compression::lz4), _Stream(LZ4_createStream()),
+        _Acceleration(level >= 1 ? 1 : 1 - level) {
+    if (!_Stream) {
+      throw pontoon::utils::Exception("Could not create lz4 stream");
+    }
+  }
+
+  ~Lz4Codec() { LZ4_freeStream(_Stream); }
+
+  size_t bound(size_t size) override { return LZ4_compressBound(size); }
+
+  size_t compress(const unsigned char *in, size_t size, unsigned char *out,
+                  size_t capacity) override {
+    // loading an empty dictionary resets the stream
+    LZ4_loadDict(_Stream, nullptr, 0);
+    int result = LZ4_compress_fast_continue(
+        _Stream, reinterpret_cast<const char *>(in),
+        reinterpret_cast<char *>(out), size, capacity, _Acceleration);
+    if (result <= 0 && size > 0) {
+      throw pontoon::utils::Exception("lz4 compression failed");
+    }
+    return result;
+  }
+
+  void decompress(const unsigned char *in, size_t size, unsigned char *out,
+                  size_t raw_size) override {
+    int result = LZ4_decompress_safe(reinterpret_cast<const char *>(in),
+                                     reinterpret_cast<char *>(out), size,
+                                     raw_size);
+    if (result < 0 || (size_t)result != raw_size) {
+      throw pontoon::utils::Exception("lz4 decompression failed");
+    }
+  }
+
+private:
+  LZ4_stream_t *_Stream;
+  const int _Acceleration;
+};
+#endif // PONTOON_WITH_LZ4
+
+} // namespace
+
+std::string Compression::backendToString(Backend backend) {
+  switch (backend) {
+  case zlib:
+    return "zlib";
+  case zstd:
+    return "zstd";
+  case lz4:
+    return "lz4";
+  }
+  throw utils::Exception("Unknown Compression::Backend (" +
+                         std::to_string(backend) + ").");
+}
+
+Compression::Backend Compression::stringToBackend(const std::string &backend) {
+  if (backend == "zlib")
+    return zlib;
+  if (backend == "zstd")
+    return zstd;
+  if (backend == "lz4")
+    return lz4;
+  throw utils::Exception(std::string("Unknown Compression::Backend: ") +
+                         backend);
+}
+
+std::string Compression::filterToString(Filter filter) {
+  switch (filter) {
+  case none:
+    return "none";
+  case sub:
+    return "sub";
+  case up:
+    return "up";
+  case paeth:
+    return "paeth";
+  }
+  throw utils::Exception("Unknown Compression::Filter (" +
+                         std::to_string(filter) + ").");
+}
+
+Compression::Filter Compression::stringToFilter(const std::string &filter) {
+  if (filter == "none")
+    return none;
+  if (filter == "sub")
+    return sub;
+  if (filter == "up")
+    return up;
+  if (filter == "paeth")
+    return paeth;
+  throw utils::Exception(std::string("Unknown Compression::Filter: ") +
+                         filter);
+}
+
+bool Compression::available(Backend backend) {
+  switch (backend) {
+  case zlib:
+    return true;
+  case zstd:
+#ifdef PONTOON_WITH_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  case lz4:
+#ifdef PONTOON_WITH_LZ4
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+CompressRstImage::CompressRstImage(const Compression::Parameters &parameters)
+    : _Parameters(parameters),
+      _Codecs(std::max<size_t>(1, parameters.threads)),
+      _Parallel(parameters.threads) {
+  // fail on construction instead of on the first image
+  codec(_Parameters.backend, 0);
+}
+
+CompressRstImage::~CompressRstImage() = default;
+
+bool CompressRstImage::isCompressed(const rst::vision::Image &image) {
+  return image.data().size() >= HEADER_SIZE_V1 &&
+         std::memcmp(image.data().data(), MAGIC, 4) == 0;
+}
+
+CompressRstImage::Codec &
+CompressRstImage::codec(Compression::Backend backend, size_t thread) {
+  auto &codec = _Codecs.at(thread).at(backend);
+  if (!codec) {
+    switch (backend) {
+    case Compression::zlib:
+      codec.reset(new ZlibCodec(_Parameters.level));
+      break;
+#ifdef PONTOON_WITH_ZSTD
+    case Compression::zstd:
+      codec.reset(new ZstdCodec(_Parameters.level));
+      break;
+#endif
+#ifdef PONTOON_WITH_LZ4
+    case Compression::lz4:
+      codec.reset(new Lz4Codec(_Parameters.level));
+      break;
+#endif
+    default:
+      throw utils::Exception("Compression backend " +
+                             Compression::backendToString(backend) +
+                             " is not available in this build.");
+    }
+  }
+  return *codec;
+}
+
+CompressRstImage::CompressedImagePtr
+CompressRstImage::compress(const UncompressedImagePtr image) {
+  return compressData(
+      *image, reinterpret_cast<const unsigned char *>(image->data().data()),
+      image->data().size());
+}
+
+CompressRstImage::CompressedImagePtr
+CompressRstImage::compress(const cv::Mat &image) {
+  const cv::Mat continuous = image.isContinuous() ? image : image.clone();
+  return compressData(metaDataOf(continuous), continuous.data,
+                      continuous.total() * continuous.elemSize());
+}
+
+CompressRstImage::CompressedImagePtr
+CompressRstImage::compressData(const rst::vision::Image &meta,
+                               const unsigned char *raw, size_t size) {
+  ConverterMetrics &metrics = codec(_Parameters.backend, 0).compressed;
+  auto time = ConverterMetrics::Clock::now();
+  try {
+    const Layout layout = layoutOf(meta, size);
+    const size_t band_count =
+        _Parameters.bands ? _Parameters.bands : _Parallel.threads();
+
+    const bool streaming = _Parameters.keyframe_interval > 0;
+    const bool keyframe = !streaming || !_HasReference ||
+                          _Reference.size() != size ||
+                          _Sequence % _Parameters.keyframe_interval == 0;
+    const bool delta = !keyframe;
+    Header header;
+    header.backend = _Parameters.backend;
+    // the XOR of two frames has no spatial structure left to predict
+    header.filter = delta ? Compression::none : _Parameters.filter;
+    header.flags = (keyframe ? 0 : REFERENCES_PREVIOUS) |
+                   (streaming ? KEEP_AS_REFERENCE | DELTA_STREAM : 0);
+    header.sequence = _Sequence;
+    header.raw_size = size;
+    header.bands = bandsOf(layout, size, band_count);
+
+    // every band compresses into its own worst case sized slot
+    size_t capacity = headerSize(header.bands.size());
+    for (Band &band : header.bands) {
+      band.data_offset = capacity;
+      capacity += codec(_Parameters.backend, 0).bound(band.raw_size);
+    }
+
+    auto result = CompressedImagePtr(new rst::vision::Image());
+    copyMetaData(meta, *result);
+    std::string *data = result->mutable_data();
+    data->resize(capacity);
+    auto *out = reinterpret_cast<unsigned char *>(&(*data)[0]);
+    const bool filtered = header.filter != Compression::none;
+    if (filtered || delta) {
+      _Filtered.resize(size);
+    }
+    _Parallel.run(header.bands.size(), [&](size_t index, size_t thread) {
+      Band &band = header.bands[index];
+      const unsigned char *input = raw + band.raw_offset;
+      if (delta) {
+        xorBytes(input, _Reference.data() + band.raw_offset,
+                 _Filtered.data() + band.raw_offset, band.raw_size);
+        input = _Filtered.data() + band.raw_offset;
+      } else if (filtered) {
+        applyFilter<false>(_Parameters.filter, layout, input,
+                           _Filtered.data() + band.raw_offset, band.raw_size);
+        input = _Filtered.data() + band.raw_offset;
+      }
+      Codec &backend = codec(_Parameters.backend, thread);
+      band.data_size =
+          backend.compress(input, band.raw_size, out + band.data_offset,
+                           backend.bound(band.raw_size));
+    });
+
+    // close the gaps between the slots
+    size_t length = headerSize(header.bands.size());
+    for (Band &band : header.bands) {
+      std::memmove(out + length, out + band.data_offset, band.data_size);
+      band.data_offset = length;
+      length += band.data_size;
+    }
+    writeHeader(header, out);
+    data->resize(length);
+
+    if (streaming) {
+      _Reference.assign(raw, raw + size);
+      _HasReference = true;
+    }
+    ++_Sequence;
+
+    metrics.record(size, data->size(), ConverterMetrics::Clock::now() - time);
+#ifdef PONTOON_FRAME_LOGGING
+    std::cerr << Compression::backendToString(_Parameters.backend)
+              << " reduced from " << size << " to " << data->size() << " = "
+              << data->size() / (double)size << " in " << header.bands.size()
+              << " bands" << std::endl;
+#endif
+    return result;
+  } catch (std::exception &e) {
+    metrics.recordError();
+    throw utils::Exception(std::string("Could not compress image: ") +
+                           e.what());
+  }
+}
+
+CompressRstImage::UncompressedImagePtr
+CompressRstImage::decompress(const CompressedImagePtr image) {
+  if (!isCompressed(*image)) {
+    return image;
+  }
+  const size_t size = readLittleEndian(
+      reinterpret_cast<const unsigned char *>(image->data().data()) + 12, 8);
+  auto result = UncompressedImagePtr(image->New());
+  copyMetaData(*image, *result);
+  std::string *raw = result->mutable_data();
+  raw->resize(size);
+  decompressData(*image, reinterpret_cast<unsigned char *>(&(*raw)[0]), size);
+  return result;
+}
+
+CompressRstImage::MatPtr
+CompressRstImage::decompressMat(const rst::vision::Image &image) {
+  auto mat = utils::FramePool::shared().create(
+      cv::Size(image.width(), image.height()), cvTypeOf(image));
+  const size_t size = mat->total() * mat->elemSize();
+  if (!isCompressed(image)) {
+    if (image.data().size() != size) {
+      throw utils::Exception("Image data does not match its size and type");
+    }
+    std::memcpy(mat->data, image.data().data(), size);
+  } else {
+    decompressData(image, mat->data, size);
+  }
+  return mat;
+}
+
+void CompressRstImage::decompressData(const rst::vision::Image &image,
+                                      unsigned char *out, size_t size) {
+  const std::string &data = image.data();
+  const Header header = readHeader(data);
+  ConverterMetrics &metrics = codec(header.backend, 0).decompressed;
+  auto time = ConverterMetrics::Clock::now();
+  try {
+    if (header.raw_size != size) {
+      throw utils::Exception("the decompressed size does not match the image");
+    }
+    const bool keyframe = !(header.flags & REFERENCES_PREVIOUS);
+    if (!keyframe && !(header.flags & DELTA_STREAM)) {
+      throw utils::Exception("frames compressed against the previous frame as "
+                             "dictionary are not supported anymore");
+    }
+    if (!keyframe && (!_HasReference || header.sequence != _Sequence + 1 ||
+                      _Reference.size() != size)) {
+      _HasReference = false;
+      throw utils::Exception("the reference frame is missing, waiting for the "
+                             "next keyframe");
+    }
+
+    const Layout layout = layoutOf(image, size);
+    const bool delta = !keyframe;
+    const bool filtered = header.filter != Compression::none;
+    unsigned char *target = out;
+    if (filtered || delta) {
+      _Filtered.resize(size);
+      target = _Filtered.data();
+    }
+    const auto *in = reinterpret_cast<const unsigned char *>(data.data());
+    _Parallel.run(header.bands.size(), [&](size_t index, size_t thread) {
+      const Band &band = header.bands[index];
+      codec(header.backend, thread)
+          .decompress(in + band.data_offset, band.data_size,
+                      target + band.raw_offset, band.raw_size);
+      if (delta) {
+        xorBytes(target + band.raw_offset, _Reference.data() + band.raw_offset,
+                 out + band.raw_offset, band.raw_size);
+      } else if (filtered) {
+        applyFilter<true>(header.filter, layout, target + band.raw_offset,
+                          out + band.raw_offset, band.raw_size);
+      }
+    });
+
+    _HasReference = header.flags & KEEP_AS_REFERENCE;
+    if (_HasReference) {
+      _Reference.assign(out, out + size);
+    }
+    _Sequence = header.sequence;
+
+    metrics.record(data.size(), size, ConverterMetrics::Clock::now() - time);
+  } catch (std::exception &e) {
+    metrics.recordError();
+    throw utils::Exception(std::string("Could not decompress image: ") +
+                           e.what());
+  }
+}
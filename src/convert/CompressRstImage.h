@@ -0,0 +1,148 @@
+/********************************************************************
+**                                                                 **
+** File   : src/convert/CompressRstImage.h                         **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include "utils/Metrics.h"
+#include "utils/ParallelFor.h"
+#include "utils/Subject.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <opencv2/core.hpp>
+#include <rst/vision/Image.pb.h>
+#include <string>
+#include <vector>
+
+namespace pontoon {
+namespace convert {
+
+struct Compression {
+
+  enum Backend {
+    zlib = 0,
+    /// only available when built with BUILD_WITH_ZSTD
+    zstd = 1,
+    /// only available when built with BUILD_WITH_LZ4
+    lz4 = 2,
+  };
+
+  /**
+   * Prediction applied per element before entropy coding, like the png row
+   * filters. Elements are the 8, 16, 32 or 64 bit channel values, neighbours
+   * are the same channel of the pixel to the left (sub), above (up) or the
+   * paeth choice of left, above and upper left.
+   */
+  enum Filter {
+    none = 0,
+    sub = 1,
+    up = 2,
+    paeth = 3,
+  };
+
+  struct Parameters {
+    Backend backend = zlib;
+    /**
+     * zlib: 0 - 9, zstd: 1 - 22 (negative for faster modes), lz4: 1 is the
+     * default speed, lower levels accelerate with 1 - level.
+     */
+    int level = 1;
+    Filter filter = none;
+    /**
+     * 0 compresses every frame on its own. Otherwise only every
+     * keyframe_interval-th frame does, the others store their XOR with the
+     * previous frame and can only be decompressed in order. Unchanged pixels
+     * become zeros, which all backends compress to almost nothing, so
+     * mostly static scenes benefit regardless of the backend. The filter
+     * only applies to keyframes.
+     */
+    size_t keyframe_interval = 0;
+    /**
+     * Frames are split into this many bands of whole rows that are
+     * compressed and decompressed independently. 0 for one band per thread.
+     */
+    size_t bands = 1;
+    /// threads working on the bands of a frame, 1 uses the calling thread
+    size_t threads = 1;
+  };
+
+  static std::string backendToString(Backend backend);
+  static Backend stringToBackend(const std::string &backend);
+  static std::string filterToString(Filter filter);
+  static Filter stringToFilter(const std::string &filter);
+
+  /// whether the backend was compiled in
+  static bool available(Backend backend);
+};
+
+/**
+ * Losslessly compresses the data of rst::vision::Images. The compressed
+ * data starts with a small header naming backend, filter and frame sequence
+ * followed by an index of the row bands, all other image fields are kept.
+ * Bands are compressed and decompressed in parallel. decompress passes
+ * images without that header through unchanged.
+ *
+ * Streams with a keyframe_interval code the frames between keyframes as
+ * delta to the previous frame.
+ * Compressor and decompressor keep codec contexts and the reference frame
+ * between calls. Not thread-safe, use one instance per thread and stream.
+ */
+class CompressRstImage {
+public:
+  typedef boost::shared_ptr<rst::vision::Image> UncompressedImagePtr;
+  typedef boost::shared_ptr<rst::vision::Image> CompressedImagePtr;
+  typedef boost::shared_ptr<cv::Mat> MatPtr;
+
+  CompressRstImage(
+      const Compression::Parameters &parameters = Compression::Parameters());
+
+  virtual ~CompressRstImage();
+
+  CompressedImagePtr compress(const UncompressedImagePtr);
+  UncompressedImagePtr decompress(const CompressedImagePtr);
+
+  /// compresses the pixels of an 8U, 16U or 32F image without copying them
+  CompressedImagePtr compress(const cv::Mat &image);
+  /// decompresses into a cv::Mat from utils::FramePool
+  MatPtr decompressMat(const rst::vision::Image &image);
+
+  static bool isCompressed(const rst::vision::Image &image);
+
+  class Codec;
+
+private:
+  Codec &codec(Compression::Backend backend, size_t thread);
+
+  CompressedImagePtr compressData(const rst::vision::Image &meta,
+                                  const unsigned char *raw, size_t size);
+  /// out must hold the decompressed size of image
+  void decompressData(const rst::vision::Image &image, unsigned char *out,
+                      size_t size);
+
+  const Compression::Parameters _Parameters;
+  /// codec contexts per thread of _Parallel
+  std::vector<std::array<std::unique_ptr<Codec>, 3>> _Codecs;
+  utils::ParallelFor _Parallel;
+  /// the last frame of a stream
+  std::vector<unsigned char> _Reference;
+  std::vector<unsigned char> _Filtered;
+  uint32_t _Sequence = 0;
+  bool _HasReference = false;
+};
+
+} // namespace convert
+} // namespace pontoon
@@ -16,68 +16,22 @@
 ********************************************************************/
 
 #include "convert/CompressRstImageZlib.h"
-#include "utils/Exception.h"
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/thread/thread_time.hpp>
-#include <zlib.h>
 
+using pontoon::convert::Compression;
 using pontoon::convert::CompressRstImageZlib;
 
-std::string error_code(int code) {
-  switch (code) {
-  case Z_OK:
-    return "Ok";
-  case Z_MEM_ERROR:
-    return "MemoryError";
-  case Z_BUF_ERROR:
-    return "BufferError";
-  default:
-    return "__unknown__";
-  }
-}
-
-CompressRstImageZlib::CompressedImagePtr
-CompressRstImageZlib::compress(const UncompressedImagePtr image) {
-  auto result = CompressedImagePtr(image->New());
-  result->CopyFrom(*image);
-
-  // reserve buffer size
-  ulong bound = ::compressBound(image->data().size());
-  if (_BufferSize < bound) {
-    _Buffer = std::unique_ptr<unsigned char>(new unsigned char[bound]);
-    _BufferSize = bound;
-  }
-
-  ulong length = _BufferSize;
-  auto time = boost::get_system_time();
-  int error = ::compress2(_Buffer.get(), &length,
-                          (const unsigned char *)image->data().c_str(),
-                          image->data().size(), 1);
-  std::cout << "compress: "
-            << (boost::get_system_time() - time).total_nanoseconds()
-            << std::endl;
-  time = boost::get_system_time();
+namespace {
 
-  if (error != Z_OK) {
-    throw utils::Exception("Could not compress image. Error = " +
-                           error_code(error));
-  }
-  assert(length <= std::numeric_limits<size_t>::max());
-
-  result->set_allocated_data(
-      new std::string((const char *)_Buffer.get(), (size_t)length));
-  std::cout << "reduced from " << image->data().size() << " = "
-            << 8 * (image->data().size() /
-                    (double)(image->width() * image->height()))
-            << " to " << result->data().size() << " = "
-            << 8 * (result->data().size() /
-                    (double)(result->width() * result->height()))
-            << " = " << result->data().size() / (double)image->data().size()
-            << std::endl;
-  return result;
+Compression::Parameters zlibParameters(int level, Compression::Filter filter) {
+  Compression::Parameters parameters;
+  parameters.backend = Compression::zlib;
+  parameters.level = level;
+  parameters.filter = filter;
+  return parameters;
 }
 
-CompressRstImageZlib::UncompressedImagePtr
-CompressRstImageZlib::decompress(const CompressedImagePtr image) {
-  return image;
-}
+} // namespace
+
+CompressRstImageZlib::CompressRstImageZlib(int level,
+                                           Compression::Filter filter)
+    : CompressRstImage(zlibParameters(level, filter)) {}
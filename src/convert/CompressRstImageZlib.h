@@ -17,27 +17,19 @@
 
 #pragma once
 
-#include "utils/Subject.h"
-#include <memory>
-#include <mutex>
-#include <rst/vision/Image.pb.h>
-#include <vector>
+#include "convert/CompressRstImage.h"
 
 namespace pontoon {
 namespace convert {
 
-class CompressRstImageZlib {
+/**
+ * A CompressRstImage fixed to the zlib backend.
+ */
+class CompressRstImageZlib : public CompressRstImage {
 public:
-  typedef boost::shared_ptr<rst::vision::Image> UncompressedImagePtr;
-  typedef boost::shared_ptr<rst::vision::Image> CompressedImagePtr;
-
-  CompressedImagePtr compress(const UncompressedImagePtr);
-  UncompressedImagePtr decompress(const CompressedImagePtr);
-
-private:
-  ulong _BufferSize = 0;
-  std::unique_ptr<unsigned char> _Buffer;
+  CompressRstImageZlib(int level = 1,
+                       Compression::Filter filter = Compression::none);
 };
 
-} // namespace extract
+} // namespace convert
 } // namespace pontoon
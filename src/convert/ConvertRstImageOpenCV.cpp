@@ -18,45 +18,128 @@
 #include "convert/ConvertRstImageOpenCV.h"
 #include "utils/CvHelpers.h"
 #include "utils/Exception.h"
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/thread/thread_time.hpp>
+#include "utils/FramePool.h"
+#include <iomanip>
+#include <sstream>
 #include <opencv2/core/types_c.h>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc.hpp>
 #include <rst/converters/opencv/IplImageConverter.h>
 
 using pontoon::convert::ImageEncoding;
 using pontoon::convert::EncodeRstVisionImage;
 using pontoon::convert::DecodeRstVisionEncodedImage;
+using pontoon::utils::ConverterMetrics;
 
-EncodeRstVisionImage::EncodeRstVisionImage(const ImageEncoding::Type &type)
+EncodeRstVisionImage::EncodeRstVisionImage(
+    const ImageEncoding::Type &type,
+    const ImageEncoding::Parameters &parameters)
     : _Encoding(type),
-      _TypeString(std::string(".") + ImageEncoding::typeToString(type)) {}
+      _TypeString(std::string(".") + ImageEncoding::typeToString(type)),
+      _Metrics(ConverterMetrics::named("encode" + _TypeString)) {
+  if (type == ImageEncoding::jpg) {
+    if (parameters.jpeg_quality >= 0) {
+      _Parameters.push_back(cv::IMWRITE_JPEG_QUALITY);
+      _Parameters.push_back(std::min(parameters.jpeg_quality, 100));
+    }
+    if (parameters.jpeg_progressive) {
+      _Parameters.push_back(cv::IMWRITE_JPEG_PROGRESSIVE);
+      _Parameters.push_back(1);
+    }
+    if (parameters.jpeg_optimize) {
+      _Parameters.push_back(cv::IMWRITE_JPEG_OPTIMIZE);
+      _Parameters.push_back(1);
+    }
+  } else if (type == ImageEncoding::png) {
+    if (parameters.png_compression >= 0) {
+      _Parameters.push_back(cv::IMWRITE_PNG_COMPRESSION);
+      _Parameters.push_back(std::min(parameters.png_compression, 9));
+    }
+  }
+}
 
 ImageEncoding::CodedPtr
 EncodeRstVisionImage::encode(const boost::shared_ptr<cv::Mat> image) {
+  return encode(*image);
+}
+
+ImageEncoding::CodedPtr EncodeRstVisionImage::encode(const cv::Mat &image) {
   try {
-    auto time = boost::get_system_time();
-    std::vector<unsigned char> result;
-    int bmpsize = image->total() * 3;
+    auto time = ConverterMetrics::Clock::now();
+    // keeps its capacity, imencode only reallocates when a frame grows
+    thread_local std::vector<unsigned char> result;
+    size_t bmpsize = image.total() * image.elemSize();
     ImageEncoding::CodedPtr resultImg(
         rst::vision::EncodedImage::default_instance().New());
     resultImg->set_encoding((rst::vision::EncodedImage_Encoding)_Encoding);
-    cv::imencode(_TypeString, *image, result);
+    cv::imencode(_TypeString, image, result, _Parameters);
     resultImg->set_data(result.data(), result.size());
+    auto latency = ConverterMetrics::Clock::now() - time;
+    _Metrics.record(bmpsize, result.size(), latency);
+#ifdef PONTOON_FRAME_LOGGING
     std::cerr << _TypeString << " c.f.: " << std::setprecision(4) << std::fixed
               << result.size() / (double)bmpsize << " ( in "
-              << (boost::get_system_time() - time).total_nanoseconds() /
-                     1000000.
+              << std::chrono::duration<double, std::milli>(latency).count()
               << "ms)" << std::endl;
+#endif
     return resultImg;
   } catch (std::exception &e) {
+    _Metrics.recordError();
     std::stringstream error;
-    error << "Cannot convert: " << image.get() << " to " << _TypeString << " - "
+    error << "Cannot convert: " << &image << " to " << _TypeString << " - "
           << e.what();
     throw utils::Exception(error.str());
   }
 }
 
+namespace {
+
+/// the number of color components in a jpeg, 0 if no frame header is found
+int jpegComponents(const std::string &data) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+  size_t pos = 2; // skip start of image
+  while (pos + 9 < data.size() && bytes[pos] == 0xFF) {
+    const unsigned char marker = bytes[pos + 1];
+    // SOF0 - SOF15 without DHT, JPG and DAC
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      return bytes[pos + 9];
+    }
+    if (marker == 0xDA) {
+      return 0; // start of scan, no frame header before the image data
+    }
+    pos += 2 + (bytes[pos + 2] << 8 | bytes[pos + 3]);
+  }
+  return 0;
+}
+
+int reducedReadFlag(int reduction, bool color) {
+  switch (reduction) {
+  case 2:
+    return color ? cv::IMREAD_REDUCED_COLOR_2 : cv::IMREAD_REDUCED_GRAYSCALE_2;
+  case 4:
+    return color ? cv::IMREAD_REDUCED_COLOR_4 : cv::IMREAD_REDUCED_GRAYSCALE_4;
+  case 8:
+    return color ? cv::IMREAD_REDUCED_COLOR_8 : cv::IMREAD_REDUCED_GRAYSCALE_8;
+  default:
+    return cv::IMREAD_UNCHANGED;
+  }
+}
+
+} // namespace
+
+DecodeRstVisionEncodedImage::DecodeRstVisionEncodedImage(
+    size_t recycled_buffers, int reduction)
+    : _RecycledBuffers(recycled_buffers), _Reduction(reduction),
+      _Metrics(ConverterMetrics::named("decode")) {
+  if (reduction != 1 && reduction != 2 && reduction != 4 && reduction != 8) {
+    std::stringstream error;
+    error << "DecodeRstVisionEncodedImage cannot reduce images by "
+          << reduction << ", use one of 1, 2, 4, 8.";
+    throw utils::Exception(error.str());
+  }
+}
+
 ImageEncoding::UncodedPtr
 DecodeRstVisionEncodedImage::decode(const ImageEncoding::CodedPtr image) {
   return decode(*image);
@@ -65,21 +148,44 @@ DecodeRstVisionEncodedImage::decode(const ImageEncoding::CodedPtr image) {
 ImageEncoding::UncodedPtr
 DecodeRstVisionEncodedImage::decode(const rst::vision::EncodedImage &image) {
   try {
-    auto time = boost::get_system_time();
-    std::vector<unsigned char> tmp;
-    tmp.resize(image.data().size());
-    std::copy(image.data().begin(), image.data().end(), tmp.begin());
-    boost::shared_ptr<cv::Mat> mat(new cv::Mat());
-    cv::imdecode(tmp, cv::IMREAD_UNCHANGED, mat.get());
+    auto time = ConverterMetrics::Clock::now();
+    // a header over the protobuf bytes, imdecode only reads them
+    const std::string &data = image.data();
+    const cv::Mat buffer(1, (int)data.size(), CV_8UC1,
+                         const_cast<char *>(data.data()));
+    boost::shared_ptr<cv::Mat> mat = unusedDestination();
+    const int components =
+        (_Reduction != 1 &&
+         image.encoding() == rst::vision::EncodedImage_Encoding_JPG)
+            ? jpegComponents(data)
+            : 0;
+    if (_Reduction == 1) {
+      cv::imdecode(buffer, cv::IMREAD_UNCHANGED, mat.get());
+    } else if (components != 0) {
+      // libjpeg scales in the DCT domain, the full image is never decoded
+      cv::imdecode(buffer, reducedReadFlag(_Reduction, components != 1),
+                   mat.get());
+    } else {
+      thread_local cv::Mat full;
+      cv::imdecode(buffer, cv::IMREAD_UNCHANGED, &full);
+      cv::resize(full, *mat, cv::Size(std::max(1, full.cols / _Reduction),
+                                      std::max(1, full.rows / _Reduction)),
+                 0, 0, cv::INTER_AREA);
+    }
+    auto latency = ConverterMetrics::Clock::now() - time;
+    _Metrics.record(data.size(), mat->total() * mat->elemSize(), latency);
+#ifdef PONTOON_FRAME_LOGGING
     std::cerr << ImageEncoding::typeToString(
                      (ImageEncoding::Type)image.encoding())
               << " i.f.: " << std::setprecision(4) << std::fixed
-              << mat->total() * 3 / (double)image.data().size() << " ( in "
-              << (boost::get_system_time() - time).total_nanoseconds() /
-                     1000000.
+              << mat->total() * mat->elemSize() / (double)data.size()
+              << " ( in "
+              << std::chrono::duration<double, std::milli>(latency).count()
               << "ms)" << std::endl;
+#endif
     return mat;
   } catch (std::exception &e) {
+    _Metrics.recordError();
     std::stringstream error;
     error << "Cannot decode image with encoding: " << image.encoding() << "  - "
           << e.what();
@@ -87,6 +193,21 @@ DecodeRstVisionEncodedImage::decode(const rst::vision::EncodedImage &image) {
   }
 }
 
+ImageEncoding::UncodedPtr DecodeRstVisionEncodedImage::unusedDestination() {
+  for (auto &destination : _Destinations) {
+    // only we hold the pointer and no cv::Mat shares its pixels
+    if (destination.use_count() == 1 &&
+        (destination->u == nullptr || destination->u->refcount == 1)) {
+      return destination;
+    }
+  }
+  auto destination = utils::FramePool::shared().create();
+  if (_Destinations.size() < _RecycledBuffers) {
+    _Destinations.push_back(destination);
+  }
+  return destination;
+}
+
 std::string ImageEncoding::typeToString(ImageEncoding::Type t) {
   switch (t) {
   case Type::ppm:
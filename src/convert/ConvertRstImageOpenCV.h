@@ -17,11 +17,14 @@
 
 #pragma once
 
+#include "convert/CompressRstImage.h"
+#include "utils/Metrics.h"
 #include "utils/Subject.h"
 #include <memory>
 #include <mutex>
 #include <opencv2/core/core_c.h>
 #include <rst/vision/EncodedImage.pb.h>
+#include <string>
 #include <vector>
 
 namespace pontoon {
@@ -40,25 +43,73 @@ struct ImageEncoding {
     tiff = rst::vision::EncodedImage_Encoding_TIFF,
   };
 
+  /// encoder settings, negative values keep the OpenCV defaults
+  struct Parameters {
+    /// 0 - 100
+    int jpeg_quality = -1;
+    bool jpeg_progressive = false;
+    bool jpeg_optimize = false;
+    /// faster, slightly less accurate DCT, only used by jpg-turbo
+    bool jpeg_fast_dct = false;
+    /// chroma subsampling ( 444 | 422 | 420 | gray ), only used by jpg-turbo
+    std::string jpeg_subsampling = "420";
+    /// 0 - 9
+    int png_compression = -1;
+    /// for the lossless zlib, zstd and lz4 encodings, the backend is ignored
+    Compression::Parameters compression;
+  };
+
   static std::string typeToString(Type t);
   static Type stringToType(const std::string &type);
 };
 
+/**
+ * Encodes into a per-thread buffer that keeps its capacity between frames,
+ * so encoding a stream does not allocate an output vector per frame. The
+ * encoder can be shared between threads.
+ */
 class EncodeRstVisionImage {
 public:
-  EncodeRstVisionImage(const ImageEncoding::Type &type);
+  EncodeRstVisionImage(const ImageEncoding::Type &type,
+                       const ImageEncoding::Parameters &parameters =
+                           ImageEncoding::Parameters());
 
   ImageEncoding::CodedPtr encode(const ImageEncoding::UncodedPtr);
 
+  ImageEncoding::CodedPtr encode(const cv::Mat &image);
+
 private:
   const ImageEncoding::Type _Encoding;
   const std::string _TypeString;
+  std::vector<int> _Parameters;
+  utils::ConverterMetrics &_Metrics;
 };
 
+/**
+ * Decodes directly from the protobuf data without copying it. Decoded
+ * images are written into one of the last recycled_buffers results when
+ * nobody references it anymore, so a steady stream of same-sized images does
+ * not allocate a new cv::Mat per frame. Not thread-safe, use one decoder
+ * per thread.
+ *
+ * A reduction of 2, 4 or 8 shrinks both image dimensions by that factor.
+ * JPEGs are then decoded at the reduced size by libjpeg's DCT scaling,
+ * other encodings are decoded in full and scaled down afterwards.
+ */
 class DecodeRstVisionEncodedImage {
 public:
+  DecodeRstVisionEncodedImage(size_t recycled_buffers = 2, int reduction = 1);
+
   ImageEncoding::UncodedPtr decode(const ImageEncoding::CodedPtr);
   ImageEncoding::UncodedPtr decode(const rst::vision::EncodedImage &);
+
+private:
+  ImageEncoding::UncodedPtr unusedDestination();
+
+  const size_t _RecycledBuffers;
+  const int _Reduction;
+  std::vector<ImageEncoding::UncodedPtr> _Destinations;
+  utils::ConverterMetrics &_Metrics;
 };
 
 } // namespace extract
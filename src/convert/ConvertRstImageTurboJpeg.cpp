@@ -0,0 +1,258 @@
+/********************************************************************
+**                                                                 **
+** File   : src/convert/ConvertRstImageTurboJpeg.cpp               **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "convert/ConvertRstImageTurboJpeg.h"
+#include "utils/Exception.h"
+#include "utils/FramePool.h"
+#include <turbojpeg.h>
+
+using pontoon::convert::DecodeRstVisionEncodedImageTurboJpeg;
+using pontoon::convert::EncodeRstVisionImageTurboJpeg;
+using pontoon::convert::ImageEncoding;
+using pontoon::convert::TurboJpeg;
+using pontoon::utils::ConverterMetrics;
+
+namespace {
+
+/// the compressor and output buffer of the calling thread
+struct CompressState {
+  tjhandle handle = tjInitCompress();
+  unsigned char *buffer = nullptr;
+  unsigned long capacity = 0;
+
+  ~CompressState() {
+    tjFree(buffer);
+    if (handle) {
+      tjDestroy(handle);
+    }
+  }
+
+  void reserve(unsigned long size) {
+    if (capacity < size) {
+      tjFree(buffer);
+      buffer = tjAlloc(size);
+      capacity = buffer ? size : 0;
+      if (!buffer) {
+        throw pontoon::utils::Exception("Could not allocate a jpeg buffer");
+      }
+    }
+  }
+};
+
+CompressState &compressState() {
+  thread_local CompressState state;
+  if (!state.handle) {
+    throw pontoon::utils::Exception(
+        std::string("Could not create a TurboJPEG compressor: ") +
+        tjGetErrorStr2(nullptr));
+  }
+  return state;
+}
+
+int tjSubsampling(TurboJpeg::Subsampling subsampling) {
+  switch (subsampling) {
+  case TurboJpeg::yuv444:
+    return TJSAMP_444;
+  case TurboJpeg::yuv422:
+    return TJSAMP_422;
+  case TurboJpeg::yuv420:
+    return TJSAMP_420;
+  case TurboJpeg::gray:
+    return TJSAMP_GRAY;
+  }
+  return TJSAMP_420;
+}
+
+int tjFlags(const TurboJpeg::Parameters &parameters) {
+  return parameters.fast_dct ? TJFLAG_FASTDCT : 0;
+}
+
+ImageEncoding::CodedPtr jpegOf(const unsigned char *data, size_t size) {
+  ImageEncoding::CodedPtr result(
+      rst::vision::EncodedImage::default_instance().New());
+  result->set_encoding(rst::vision::EncodedImage_Encoding_JPG);
+  result->set_data(data, size);
+  return result;
+}
+
+} // namespace
+
+std::string TurboJpeg::subsamplingToString(Subsampling subsampling) {
+  switch (subsampling) {
+  case yuv444:
+    return "444";
+  case yuv422:
+    return "422";
+  case yuv420:
+    return "420";
+  case gray:
+    return "gray";
+  }
+  throw utils::Exception("Unknown TurboJpeg::Subsampling (" +
+                         std::to_string(subsampling) + ").");
+}
+
+TurboJpeg::Subsampling
+TurboJpeg::stringToSubsampling(const std::string &subsampling) {
+  if (subsampling == "444")
+    return yuv444;
+  if (subsampling == "422")
+    return yuv422;
+  if (subsampling == "420")
+    return yuv420;
+  if (subsampling == "gray")
+    return gray;
+  throw utils::Exception(std::string("Unknown TurboJpeg::Subsampling: ") +
+                         subsampling);
+}
+
+EncodeRstVisionImageTurboJpeg::EncodeRstVisionImageTurboJpeg(
+    const TurboJpeg::Parameters &parameters)
+    : _Parameters(parameters),
+      _Metrics(ConverterMetrics::named("encode.turbojpg")) {}
+
+ImageEncoding::CodedPtr
+EncodeRstVisionImageTurboJpeg::encode(const ImageEncoding::UncodedPtr image) {
+  return encode(*image);
+}
+
+ImageEncoding::CodedPtr
+EncodeRstVisionImageTurboJpeg::encode(const cv::Mat &image) {
+  auto time = ConverterMetrics::Clock::now();
+  int format = TJPF_BGR;
+  int subsampling = tjSubsampling(_Parameters.subsampling);
+  switch (image.type()) {
+  case CV_8UC3:
+    format = TJPF_BGR;
+    break;
+  case CV_8UC4:
+    format = TJPF_BGRA;
+    break;
+  case CV_8UC1:
+    format = TJPF_GRAY;
+    subsampling = TJSAMP_GRAY;
+    break;
+  default:
+    _Metrics.recordError();
+    throw utils::Exception("TurboJPEG can only encode 8 bit images with 1, 3 "
+                           "or 4 channels.");
+  }
+
+  CompressState &state = compressState();
+  state.reserve(tjBufSize(image.cols, image.rows, subsampling));
+  unsigned long length = state.capacity;
+  const int flags = tjFlags(_Parameters) | TJFLAG_NOREALLOC;
+  if (tjCompress2(state.handle, image.data, image.cols, image.step, image.rows,
+                  format, &state.buffer, &length, subsampling,
+                  _Parameters.quality, flags)) {
+    _Metrics.recordError();
+    throw utils::Exception(std::string("TurboJPEG encoding failed: ") +
+                           tjGetErrorStr2(state.handle));
+  }
+  auto result = jpegOf(state.buffer, length);
+  _Metrics.record(image.total() * image.elemSize(), length,
+                  ConverterMetrics::Clock::now() - time);
+  return result;
+}
+
+ImageEncoding::CodedPtr
+EncodeRstVisionImageTurboJpeg::encodeI420(const cv::Mat &yuv) {
+  auto time = ConverterMetrics::Clock::now();
+  if (yuv.type() != CV_8UC1 || !yuv.isContinuous() || yuv.cols % 2 != 0 ||
+      yuv.rows % 3 != 0) {
+    _Metrics.recordError();
+    throw utils::Exception("I420 frames need to be continuous CV_8UC1 images "
+                           "with an even width and height * 3 / 2 rows.");
+  }
+  const int width = yuv.cols;
+  const int height = yuv.rows * 2 / 3;
+  const size_t luma = size_t(width) * height;
+  const unsigned char *planes[3] = {yuv.data, yuv.data + luma,
+                                    yuv.data + luma + luma / 4};
+  const int strides[3] = {width, width / 2, width / 2};
+
+  CompressState &state = compressState();
+  state.reserve(tjBufSize(width, height, TJSAMP_420));
+  unsigned long length = state.capacity;
+  if (tjCompressFromYUVPlanes(state.handle, planes, width, strides, height,
+                              TJSAMP_420, &state.buffer, &length,
+                              _Parameters.quality,
+                              tjFlags(_Parameters) | TJFLAG_NOREALLOC)) {
+    _Metrics.recordError();
+    throw utils::Exception(std::string("TurboJPEG encoding failed: ") +
+                           tjGetErrorStr2(state.handle));
+  }
+  auto result = jpegOf(state.buffer, length);
+  _Metrics.record(yuv.total(), length, ConverterMetrics::Clock::now() - time);
+  return result;
+}
+
+DecodeRstVisionEncodedImageTurboJpeg::DecodeRstVisionEncodedImageTurboJpeg(
+    int reduction)
+    : _Reduction(reduction), _Handle(tjInitDecompress(), [](void *handle) {
+        if (handle) {
+          tjDestroy(handle);
+        }
+      }),
+      _Fallback(2, reduction),
+      _Metrics(ConverterMetrics::named("decode.turbojpg")) {
+  if (!_Handle) {
+    throw utils::Exception(
+        std::string("Could not create a TurboJPEG decompressor: ") +
+        tjGetErrorStr2(nullptr));
+  }
+}
+
+ImageEncoding::UncodedPtr
+DecodeRstVisionEncodedImageTurboJpeg::decode(
+    const ImageEncoding::CodedPtr image) {
+  return decode(*image);
+}
+
+ImageEncoding::UncodedPtr DecodeRstVisionEncodedImageTurboJpeg::decode(
+    const rst::vision::EncodedImage &image) {
+  if (image.encoding() != rst::vision::EncodedImage_Encoding_JPG) {
+    return _Fallback.decode(image);
+  }
+  auto time = ConverterMetrics::Clock::now();
+  const auto *data =
+      reinterpret_cast<const unsigned char *>(image.data().data());
+  const unsigned long size = image.data().size();
+  int width = 0, height = 0, subsampling = 0, colorspace = 0;
+  if (tjDecompressHeader3(_Handle.get(), data, size, &width, &height,
+                          &subsampling, &colorspace)) {
+    _Metrics.recordError();
+    throw utils::Exception(std::string("Cannot read jpeg header: ") +
+                           tjGetErrorStr2(_Handle.get()));
+  }
+  // libjpeg scales in the DCT domain, the full image is never decoded
+  const tjscalingfactor factor = {1, _Reduction};
+  const int scaled_width = TJSCALED(width, factor);
+  const int scaled_height = TJSCALED(height, factor);
+  const bool gray = subsampling == TJSAMP_GRAY;
+  auto mat = utils::FramePool::shared().create(
+      cv::Size(scaled_width, scaled_height), gray ? CV_8UC1 : CV_8UC3);
+  if (tjDecompress2(_Handle.get(), data, size, mat->data, scaled_width,
+                    mat->step, scaled_height, gray ? TJPF_GRAY : TJPF_BGR, 0)) {
+    _Metrics.recordError();
+    throw utils::Exception(std::string("TurboJPEG decoding failed: ") +
+                           tjGetErrorStr2(_Handle.get()));
+  }
+  _Metrics.record(size, mat->total() * mat->elemSize(),
+                  ConverterMetrics::Clock::now() - time);
+  return mat;
+}
@@ -0,0 +1,105 @@
+/********************************************************************
+**                                                                 **
+** File   : src/convert/ConvertRstImageTurboJpeg.h                 **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include "convert/ConvertRstImageOpenCV.h"
+#include "utils/Metrics.h"
+#include <memory>
+#include <opencv2/core.hpp>
+#include <string>
+
+namespace pontoon {
+namespace convert {
+
+/**
+ * JPEG coding through the libjpeg-turbo TurboJPEG API. Only available when
+ * built with BUILD_WITH_TURBOJPEG.
+ */
+struct TurboJpeg {
+
+  enum Subsampling {
+    /// full chroma resolution
+    yuv444,
+    /// half horizontal chroma resolution
+    yuv422,
+    /// half horizontal and vertical chroma resolution
+    yuv420,
+    /// luminance only
+    gray,
+  };
+
+  struct Parameters {
+    /// 1 - 100
+    int quality = 90;
+    Subsampling subsampling = yuv420;
+    /// faster, slightly less accurate DCT
+    bool fast_dct = false;
+  };
+
+  static std::string subsamplingToString(Subsampling subsampling);
+  static Subsampling stringToSubsampling(const std::string &subsampling);
+};
+
+/**
+ * Encodes BGR, BGRA and grayscale images or planar YUV 4:2:0 frames into
+ * JPEGs. Compressor handles and output buffers are kept per thread and
+ * reused between frames, the encoder can be shared between threads.
+ */
+class EncodeRstVisionImageTurboJpeg {
+public:
+  EncodeRstVisionImageTurboJpeg(
+      const TurboJpeg::Parameters &parameters = TurboJpeg::Parameters());
+
+  ImageEncoding::CodedPtr encode(const ImageEncoding::UncodedPtr image);
+  ImageEncoding::CodedPtr encode(const cv::Mat &image);
+
+  /**
+   * Encodes an I420 frame as produced by cv::COLOR_BGR2YUV_I420: a CV_8UC1
+   * image of height * 3 / 2 rows holding the Y, U and V planes. The frame is
+   * always encoded with 4:2:0 subsampling and skips the color conversion.
+   */
+  ImageEncoding::CodedPtr encodeI420(const cv::Mat &yuv);
+
+private:
+  const TurboJpeg::Parameters _Parameters;
+  utils::ConverterMetrics &_Metrics;
+};
+
+/**
+ * Decodes JPEGs with TurboJPEG, other encodings with
+ * DecodeRstVisionEncodedImage. A reduction of 2, 4 or 8 decodes JPEGs at the
+ * reduced size. Results come from utils::FramePool. Not thread-safe, use one
+ * decoder per thread.
+ */
+class DecodeRstVisionEncodedImageTurboJpeg {
+public:
+  DecodeRstVisionEncodedImageTurboJpeg(int reduction = 1);
+
+  ImageEncoding::UncodedPtr decode(const ImageEncoding::CodedPtr);
+  ImageEncoding::UncodedPtr decode(const rst::vision::EncodedImage &);
+
+private:
+  const int _Reduction;
+  /// the tjhandle
+  std::shared_ptr<void> _Handle;
+  DecodeRstVisionEncodedImage _Fallback;
+  utils::ConverterMetrics &_Metrics;
+};
+
+} // namespace convert
+} // namespace pontoon
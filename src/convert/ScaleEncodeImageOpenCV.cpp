@@ -0,0 +1,36 @@
+/********************************************************************
+**                                                                 **
+** File   : src/convert/ScaleEncodeImageOpenCV.cpp                 **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "convert/ScaleEncodeImageOpenCV.h"
+
+using pontoon::convert::ImageEncoding;
+using pontoon::convert::ScaleEncodeRstVisionImage;
+
+ScaleEncodeRstVisionImage::ScaleEncodeRstVisionImage(
+    const ScaleImageOpenCV &scale, const ImageEncoding::Type &type,
+    const ImageEncoding::Parameters &parameters)
+    : _Scale(scale), _Encode(type, parameters) {}
+
+ImageEncoding::CodedPtr
+ScaleEncodeRstVisionImage::encode(const ImageEncoding::UncodedPtr image) {
+  if (_Scale.targetSize(image->size()) == image->size()) {
+    return _Encode.encode(*image);
+  }
+  thread_local cv::Mat scaled;
+  _Scale.scale(*image, scaled);
+  return _Encode.encode(scaled);
+}
@@ -0,0 +1,48 @@
+/********************************************************************
+**                                                                 **
+** File   : src/convert/ScaleEncodeImageOpenCV.h                   **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include "convert/ConvertRstImageOpenCV.h"
+#include "convert/ScaleImageOpenCV.h"
+
+namespace pontoon {
+namespace convert {
+
+/**
+ * Scales and encodes in one step. The scaled image is written into a
+ * per-thread scratch buffer that is reused between frames and handed to the
+ * encoder directly, so no scaled frame is allocated or reference counted.
+ * When the image already has the target size it is encoded without a copy.
+ * The converter can be shared between threads.
+ */
+class ScaleEncodeRstVisionImage {
+public:
+  ScaleEncodeRstVisionImage(const ScaleImageOpenCV &scale,
+                            const ImageEncoding::Type &type,
+                            const ImageEncoding::Parameters &parameters =
+                                ImageEncoding::Parameters());
+
+  ImageEncoding::CodedPtr encode(const ImageEncoding::UncodedPtr image);
+
+private:
+  const ScaleImageOpenCV _Scale;
+  EncodeRstVisionImage _Encode;
+};
+
+} // namespace convert
+} // namespace pontoon
@@ -18,24 +18,121 @@
 #include "convert/ScaleImageOpenCV.h"
 #include "utils/CvHelpers.h"
 #include "utils/Exception.h"
+#include "utils/FramePool.h"
+#include <algorithm>
 #include <opencv2/imgproc.hpp>
 
 using pontoon::convert::ScaleImageOpenCV;
 typedef ScaleImageOpenCV::ImgType ImgType;
 
-ScaleImageOpenCV::ScaleImageOpenCV(double scale_width, double scale_height)
-    : _width(scale_width), _height(scale_height) {}
+std::string
+ScaleImageOpenCV::interpolationToString(Interpolation interpolation) {
+  switch (interpolation) {
+  case automatic:
+    return "auto";
+  case nearest:
+    return "nearest";
+  case linear:
+    return "linear";
+  case area:
+    return "area";
+  case cubic:
+    return "cubic";
+  }
+  throw utils::Exception("Unknown ScaleImageOpenCV::Interpolation");
+}
+
+ScaleImageOpenCV::Interpolation
+ScaleImageOpenCV::stringToInterpolation(const std::string &interpolation) {
+  if (interpolation == "auto")
+    return automatic;
+  if (interpolation == "nearest")
+    return nearest;
+  if (interpolation == "linear")
+    return linear;
+  if (interpolation == "area")
+    return area;
+  if (interpolation == "cubic")
+    return cubic;
+  throw utils::Exception(
+      std::string("Unknown ScaleImageOpenCV::Interpolation: ") + interpolation);
+}
+
+ScaleImageOpenCV::ScaleImageOpenCV(double scale_width, double scale_height,
+                                   Interpolation interpolation)
+    : _width(scale_width), _height(scale_height),
+      _interpolation(interpolation) {
+  if (_width <= 0. || _height <= 0.) {
+    throw utils::Exception("ScaleImageOpenCV needs factors greater than 0");
+  }
+}
+
+ScaleImageOpenCV::ScaleImageOpenCV(const cv::Size &target,
+                                   Interpolation interpolation)
+    : _width(1.), _height(1.), _target(target),
+      _interpolation(interpolation) {
+  if (_target.width < 0 || _target.height < 0 ||
+      (_target.width == 0 && _target.height == 0)) {
+    throw utils::Exception("ScaleImageOpenCV needs a positive target size");
+  }
+}
+
+cv::Size ScaleImageOpenCV::targetSize(const cv::Size &input) const {
+  if (input.width <= 0 || input.height <= 0) {
+    // nothing to scale, empty images are passed on
+    return input;
+  } else if (_target.width > 0 && _target.height > 0) {
+    return _target;
+  } else if (_target.width > 0) {
+    return cv::Size(_target.width, std::max(1, cvRound(double(input.height) *
+                                                       _target.width /
+                                                       input.width)));
+  } else if (_target.height > 0) {
+    return cv::Size(std::max(1, cvRound(double(input.width) * _target.height /
+                                        input.height)),
+                    _target.height);
+  }
+  return cv::Size(std::max(1, int(input.width * _width)),
+                  std::max(1, int(input.height * _height)));
+}
 
 ImgType ScaleImageOpenCV::scale(const ImgType image) const {
-  cv::InterpolationFlags interpol = cv::INTER_LINEAR;
-  if (_width == 1. && _height == 1.) {
+  const cv::Size size = targetSize(image->size());
+  if (size == image->size()) {
     return image; // scaling not needed
-  } else if (_width < 1. || _height < 1.) {
-    interpol = cv::INTER_AREA;
-  } else {
-    interpol = cv::INTER_CUBIC;
   }
-  cv::Mat dst(cv::Size(image->cols*_width, image->rows*_height), image->type());
-  cv::resize(*image, dst, dst.size(), 0, 0, interpol);
-  return ImgType(new cv::Mat(dst));
+  auto dst = utils::FramePool::shared().create(size, image->type());
+  scale(*image, *dst);
+  return dst;
+}
+
+void ScaleImageOpenCV::scale(const cv::Mat &image, cv::Mat &dst) const {
+  const cv::Size size = targetSize(image.size());
+  if (size == image.size()) {
+    image.copyTo(dst);
+    return;
+  }
+  const bool downscale = size.width <= image.cols && size.height <= image.rows;
+
+  dst.create(size, image.type());
+  switch (_interpolation) {
+  case automatic:
+    if (!downscale) {
+      cv::resize(image, dst, size, 0, 0, cv::INTER_LINEAR);
+      break;
+    }
+  // fall through
+  case area:
+    cv::resize(image, dst, size, 0, 0, cv::INTER_AREA);
+    break;
+  case nearest:
+    cv::resize(image, dst, size, 0, 0, cv::INTER_NEAREST);
+    break;
+  case linear:
+    cv::resize(image, dst, size, 0, 0, cv::INTER_LINEAR);
+    break;
+  case cubic:
+    cv::resize(image, dst, size, 0, 0, cv::INTER_CUBIC);
+    break;
+  }
 }
@@ -18,22 +18,57 @@
 #pragma once
 
 #include "utils/Subject.h"
+#include <opencv2/core.hpp>
 #include <opencv2/core/core_c.h>
+#include <string>
 
 namespace pontoon {
 namespace convert {
 
+/**
+ * Scales images either by constant factors or to a fixed target resolution.
+ * Results are allocated from utils::FramePool so the destination buffer of
+ * an output size is reused once the previous frame was released.
+ *
+ * Interpolation::automatic uses INTER_AREA for downscaling and INTER_LINEAR
+ * for upscaling. Empty images are passed on unscaled. The scaler is
+ * stateless and can be shared between threads.
+ */
 class ScaleImageOpenCV {
 public:
   using ImgType = boost::shared_ptr<cv::Mat>;
 
-  ScaleImageOpenCV(double scale_width, double scale_height);
+  enum Interpolation { automatic, nearest, linear, area, cubic };
+
+  static std::string interpolationToString(Interpolation interpolation);
+  static Interpolation stringToInterpolation(const std::string &interpolation);
+
+  ScaleImageOpenCV(double scale_width, double scale_height,
+                   Interpolation interpolation = automatic);
+
+  /**
+   * Scales every image to target. If one of the dimensions is 0 it is
+   * derived from the other one keeping the aspect ratio.
+   */
+  ScaleImageOpenCV(const cv::Size &target,
+                   Interpolation interpolation = automatic);
 
   ImgType scale(const ImgType image) const;
 
+  /**
+   * Scales image into dst, which is only reallocated when its size or type
+   * does not match. Copies the image if no scaling is needed.
+   */
+  void scale(const cv::Mat &image, cv::Mat &dst) const;
+
+  /// the size scale produces for an input of the passed size
+  cv::Size targetSize(const cv::Size &input) const;
+
 private:
   double _width;
   double _height;
+  cv::Size _target;
+  Interpolation _interpolation;
 };
 
 } // namespace extract
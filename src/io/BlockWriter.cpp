@@ -0,0 +1,304 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/BlockWriter.cpp                                 **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/BlockWriter.h"
+#include "utils/Exception.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+using pontoon::io::BlockWriter;
+using pontoon::io::BlockWriting;
+
+namespace {
+
+/// what O_DIRECT needs for buffer addresses, sizes and file offsets
+const size_t DIRECT_ALIGNMENT = 4096;
+
+size_t roundUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+std::string systemError() { return std::strerror(errno); }
+
+} // namespace
+
+std::string BlockWriting::backendToString(Backend backend) {
+  switch (backend) {
+  case sync:
+    return "sync";
+  case thread:
+    return "thread";
+  }
+  throw utils::Exception("Unknown BlockWriting::Backend (" +
+                         std::to_string(backend) + ").");
+}
+
+BlockWriting::Backend
+BlockWriting::stringToBackend(const std::string &backend) {
+  if (backend == "sync")
+    return sync;
+  if (backend == "thread")
+    return thread;
+  throw utils::Exception(std::string("Unknown BlockWriting::Backend: ") +
+                         backend);
+}
+
+BlockWriter::BlockWriter(const std::string &file_name,
+                         const Parameters &parameters)
+    : _File(::open(file_name.c_str(),
+                   O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC |
+                       (parameters.direct ? O_DIRECT : 0),
+                   0644)),
+      _FileName(file_name), _Parameters(parameters), _Opened(Clock::now()) {
+  if (_File < 0) {
+    throw utils::Exception("Could not open " + file_name + ": " +
+                           systemError());
+  }
+  _Parameters.block_size = roundUp(
+      std::max(_Parameters.block_size, DIRECT_ALIGNMENT), DIRECT_ALIGNMENT);
+  _Parameters.blocks = _Parameters.backend == BlockWriting::thread
+                           ? std::max<size_t>(2, _Parameters.blocks)
+                           : 1;
+  if (_Parameters.preallocate > 0 &&
+      ::fallocate(_File, FALLOC_FL_KEEP_SIZE, 0, _Parameters.preallocate) !=
+          0) {
+    std::cerr << "WARNING: could not preallocate " << file_name << ": "
+              << systemError() << std::endl;
+  }
+  for (size_t i = 0; i < _Parameters.blocks; ++i) {
+    void *buffer = nullptr;
+    if (::posix_memalign(&buffer, DIRECT_ALIGNMENT, _Parameters.block_size) !=
+        0) {
+      for (unsigned char *allocated : _Buffers) {
+        std::free(allocated);
+      }
+      ::close(_File);
+      throw utils::Exception("Could not allocate write blocks");
+    }
+    _Buffers.push_back(static_cast<unsigned char *>(buffer));
+  }
+  _Current = _Buffers.front();
+  _Free.assign(_Buffers.begin() + 1, _Buffers.end());
+  if (_Parameters.backend == BlockWriting::thread) {
+    _Thread = std::thread(&BlockWriter::writeLoop, this);
+  }
+}
+
+BlockWriter::~BlockWriter() {
+  try {
+    close();
+  } catch (const std::exception &e) {
+    std::cerr << "Could not close " << _FileName << ": " << e.what()
+              << std::endl;
+  }
+  for (unsigned char *buffer : _Buffers) {
+    std::free(buffer);
+  }
+}
+
+void BlockWriter::append(const void *data, size_t size) {
+  if (_File < 0) {
+    throw utils::Exception(_FileName + " is closed");
+  }
+  if (_Parameters.backend == BlockWriting::thread) {
+    // a failed write leaves the writer without a current block
+    std::lock_guard<std::mutex> lock(_Mutex);
+    rethrow();
+  }
+  const auto *in = static_cast<const unsigned char *>(data);
+  // only synchronous buffered writes may skip the copy of whole blocks, the
+  // others need the data in an aligned block that outlives this call
+  const bool skip_copy =
+      _Parameters.backend == BlockWriting::sync && !_Parameters.direct;
+  while (size > 0) {
+    if (skip_copy && _Fill == 0 && size >= _Parameters.block_size) {
+      const size_t whole = size - size % _Parameters.block_size;
+      auto start = Clock::now();
+      writeBlock(in, whole);
+      stalled(Clock::now() - start);
+      in += whole;
+      size -= whole;
+      _Offset += whole;
+      continue;
+    }
+    const size_t count = std::min(size, _Parameters.block_size - _Fill);
+    std::memcpy(_Current + _Fill, in, count);
+    _Fill += count;
+    _Offset += count;
+    in += count;
+    size -= count;
+    if (_Fill == _Parameters.block_size) {
+      submit();
+    }
+  }
+}
+
+void BlockWriter::pad(size_t alignment) {
+  static const unsigned char zeros[DIRECT_ALIGNMENT] = {};
+  if (alignment > DIRECT_ALIGNMENT) {
+    throw utils::Exception("Cannot pad to more than 4096 bytes");
+  }
+  append(zeros, roundUp(_Offset, alignment) - _Offset);
+}
+
+uint64_t BlockWriter::offset() const { return _Offset; }
+
+void BlockWriter::close() {
+  if (_File < 0) {
+    return;
+  }
+  std::exception_ptr error;
+  try {
+    if (_Fill > 0) {
+      // O_DIRECT writes whole sectors, the file is truncated afterwards
+      const size_t size = _Parameters.direct
+                              ? roundUp(_Fill, DIRECT_ALIGNMENT)
+                              : _Fill;
+      std::memset(_Current + _Fill, 0, size - _Fill);
+      _Fill = size;
+      submit();
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  if (_Thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(_Mutex);
+      _Closing = true;
+    }
+    _Changed.notify_all();
+    _Thread.join();
+  }
+  if (!error) {
+    error = _Error;
+  }
+  if ((_Parameters.direct || _Parameters.preallocate > 0) && !error &&
+      ::ftruncate(_File, _Offset) != 0) {
+    error = std::make_exception_ptr(utils::Exception(
+        "Could not truncate " + _FileName + ": " + systemError()));
+  }
+  if (::close(_File) != 0 && !error) {
+    error = std::make_exception_ptr(utils::Exception(
+        "Could not close " + _FileName + ": " + systemError()));
+  }
+  _File = -1;
+  {
+    std::lock_guard<std::mutex> lock(_Mutex);
+    _Statistics.elapsed = Clock::now() - _Opened;
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+BlockWriter::Statistics BlockWriter::statistics() const {
+  std::lock_guard<std::mutex> lock(_Mutex);
+  Statistics statistics = _Statistics;
+  if (_File >= 0) {
+    statistics.elapsed = Clock::now() - _Opened;
+  }
+  return statistics;
+}
+
+void BlockWriter::submit() {
+  if (_Parameters.backend == BlockWriting::sync) {
+    auto start = Clock::now();
+    writeBlock(_Current, _Fill);
+    stalled(Clock::now() - start);
+    _Fill = 0;
+    return;
+  }
+  std::unique_lock<std::mutex> lock(_Mutex);
+  rethrow();
+  _Pending.push_back(Block{_Current, _Fill});
+  _Current = nullptr;
+  _Fill = 0;
+  _Changed.notify_all();
+  if (_Free.empty()) {
+    auto start = Clock::now();
+    _Changed.wait(lock, [this]() { return !_Free.empty() || _Error; });
+    lock.unlock();
+    stalled(Clock::now() - start);
+    lock.lock();
+    rethrow();
+  }
+  _Current = _Free.back();
+  _Free.pop_back();
+}
+
+void BlockWriter::writeBlock(const unsigned char *data, size_t size) {
+  auto start = Clock::now();
+  const size_t total = size;
+  while (size > 0) {
+    const ssize_t written = ::write(_File, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw utils::Exception("Could not write " + _FileName + ": " +
+                             systemError());
+    }
+    data += written;
+    size -= written;
+  }
+  std::lock_guard<std::mutex> lock(_Mutex);
+  _Statistics.bytes += total;
+  _Statistics.write_time += Clock::now() - start;
+}
+
+void BlockWriter::writeLoop() {
+  std::unique_lock<std::mutex> lock(_Mutex);
+  for (;;) {
+    _Changed.wait(lock, [this]() { return !_Pending.empty() || _Closing; });
+    if (_Pending.empty()) {
+      return;
+    }
+    Block block = _Pending.front();
+    _Pending.pop_front();
+    if (!_Error) {
+      lock.unlock();
+      try {
+        writeBlock(block.data, block.size);
+      } catch (...) {
+        lock.lock();
+        _Error = std::current_exception();
+        lock.unlock();
+      }
+      lock.lock();
+    }
+    _Free.push_back(block.data);
+    _Changed.notify_all();
+  }
+}
+
+void BlockWriter::stalled(Clock::duration time) {
+  std::lock_guard<std::mutex> lock(_Mutex);
+  ++_Statistics.stalls;
+  _Statistics.stall_time += time;
+  _Statistics.max_stall = std::max(_Statistics.max_stall, time);
+}
+
+void BlockWriter::rethrow() {
+  if (_Error) {
+    std::rethrow_exception(_Error);
+  }
+}
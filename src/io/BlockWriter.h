@@ -0,0 +1,142 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/BlockWriter.h                                   **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pontoon {
+namespace io {
+
+struct BlockWriting {
+  typedef std::chrono::steady_clock Clock;
+
+  enum Backend {
+    /// write in the calling thread
+    sync,
+    /// write in a dedicated I/O thread
+    thread,
+  };
+
+  struct Parameters {
+    Backend backend = sync;
+    /// rounded up to a multiple of 4096
+    size_t block_size = size_t(4) << 20;
+    /// blocks of the thread backend, at least 2
+    size_t blocks = 4;
+    /// bypass the page cache
+    bool direct = false;
+    /// bytes reserved on disk when opening, 0 for none
+    uint64_t preallocate = 0;
+  };
+
+  struct Statistics {
+    /// bytes that reached the file
+    uint64_t bytes = 0;
+    /// time spent in write calls
+    Clock::duration write_time = Clock::duration::zero();
+    /// how often and how long the caller had to wait for the disk
+    size_t stalls = 0;
+    Clock::duration stall_time = Clock::duration::zero();
+    Clock::duration max_stall = Clock::duration::zero();
+    /// since opening the file
+    Clock::duration elapsed = Clock::duration::zero();
+  };
+
+  static std::string backendToString(Backend backend);
+  static Backend stringToBackend(const std::string &backend);
+};
+
+/**
+ * Appends data to a file in large, aligned blocks.
+ *
+ * The sync backend writes full blocks in the calling thread. The thread
+ * backend hands them to a dedicated I/O thread and continues in the next
+ * free block, so the caller only waits when all blocks are in flight, e.g.
+ * while the page cache writes back. Optionally the file is opened with
+ * O_DIRECT to bypass the page cache and preallocated with fallocate.
+ * Not thread-safe.
+ */
+class BlockWriter {
+public:
+  typedef BlockWriting::Clock Clock;
+  typedef BlockWriting::Parameters Parameters;
+  typedef BlockWriting::Statistics Statistics;
+
+  BlockWriter(const std::string &file_name,
+              const Parameters &parameters = Parameters());
+  /// closes the file, errors are printed to std::cerr
+  ~BlockWriter();
+
+  BlockWriter(const BlockWriter &) = delete;
+  BlockWriter &operator=(const BlockWriter &) = delete;
+
+  void append(const void *data, size_t size);
+
+  /// appends zeros up to the next multiple of alignment (at most 4096)
+  void pad(size_t alignment);
+
+  /// bytes appended so far
+  uint64_t offset() const;
+
+  /// writes the remaining data and closes the file
+  void close();
+
+  Statistics statistics() const;
+
+private:
+  /// hands the current block to the backend and continues in a free one
+  void submit();
+  void writeBlock(const unsigned char *data, size_t size);
+  void writeLoop();
+  void stalled(Clock::duration time);
+  void rethrow();
+
+  struct Block {
+    unsigned char *data;
+    size_t size;
+  };
+
+  int _File;
+  const std::string _FileName;
+  Parameters _Parameters;
+  std::vector<unsigned char *> _Buffers;
+  unsigned char *_Current = nullptr;
+  size_t _Fill = 0;
+  uint64_t _Offset = 0;
+  const Clock::time_point _Opened;
+
+  mutable std::mutex _Mutex;
+  std::condition_variable _Changed;
+  std::deque<Block> _Pending;
+  std::vector<unsigned char *> _Free;
+  bool _Closing = false;
+  std::exception_ptr _Error;
+  Statistics _Statistics;
+  std::thread _Thread;
+};
+
+} // namespace io
+} // namespace pontoon
@@ -0,0 +1,317 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/Pipeline.cpp                                    **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/Pipeline.h"
+#include "convert/ScaleImageOpenCV.h"
+#include "io/rst/InformerCVImage.h"
+#include "io/rst/ListenerCVImage.h"
+#include "utils/Exception.h"
+#include "utils/OverflowPolicy.h"
+#include <atomic>
+#include <boost/lexical_cast.hpp>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+using pontoon::io::Pipeline;
+using pontoon::io::rst::Trace;
+using pontoon::convert::ImageEncoding;
+using pontoon::convert::ScaleImageOpenCV;
+using pontoon::utils::OverflowPolicy;
+
+namespace {
+
+typedef std::function<bool(Pipeline::Frame &)> Step;
+
+/// reads the options of an element, options never read are rejected
+class Options {
+public:
+  Options(const Pipeline::Element &element) : _element(element) {}
+
+  bool has(const std::string &key) const {
+    return _element.options.count(key) > 0;
+  }
+
+  template <typename T> T get(const std::string &key, const T &fallback) {
+    auto option = _element.options.find(key);
+    if (option == _element.options.end()) {
+      return fallback;
+    }
+    _used.insert(key);
+    try {
+      return boost::lexical_cast<T>(option->second);
+    } catch (const boost::bad_lexical_cast &) {
+      throw invalid(key);
+    }
+  }
+
+  template <typename T> T require(const std::string &key) {
+    if (!has(key)) {
+      throw pontoon::utils::Exception("The " + _element.name +
+                                      " element needs the option " + key +
+                                      ".");
+    }
+    return get<T>(key, T());
+  }
+
+  bool flag(const std::string &key, bool fallback) {
+    auto value = get<std::string>(key, fallback ? "true" : "false");
+    if (value == "true" || value == "1") {
+      return true;
+    }
+    if (value == "false" || value == "0") {
+      return false;
+    }
+    throw invalid(key);
+  }
+
+  void checkUsed() const {
+    for (const auto &option : _element.options) {
+      if (!_used.count(option.first)) {
+        throw pontoon::utils::Exception("Unknown option " + option.first +
+                                        " of the " + _element.name +
+                                        " element.");
+      }
+    }
+  }
+
+private:
+  pontoon::utils::Exception invalid(const std::string &key) const {
+    return pontoon::utils::Exception("Invalid value for option " + key +
+                                     " of the " + _element.name +
+                                     " element: " +
+                                     _element.options.at(key));
+  }
+
+  const Pipeline::Element &_element;
+  std::set<std::string> _used;
+};
+
+Step scaleStep(Options &options) {
+  const auto interpolation = ScaleImageOpenCV::stringToInterpolation(
+      options.get<std::string>("interpolation", "auto"));
+  const double scale_width = options.get<double>("scale-width", 1.);
+  const double scale_height = options.get<double>("scale-height", 1.);
+  const int width = options.get<int>("width", 0);
+  const int height = options.get<int>("height", 0);
+  if (scale_width <= 0 || scale_height <= 0 || width < 0 || height < 0) {
+    throw pontoon::utils::Exception(
+        "The scale element cannot scale to a negative size.");
+  }
+  auto scale = std::make_shared<ScaleImageOpenCV>(
+      (width > 0 || height > 0)
+          ? ScaleImageOpenCV(cv::Size(width, height), interpolation)
+          : ScaleImageOpenCV(scale_width, scale_height, interpolation));
+  return [scale](Pipeline::Frame &frame) {
+    frame.image = scale->scale(frame.image);
+    frame.trace.stamp(Trace::scaled);
+    return true;
+  };
+}
+
+Step cropStep(Options &options) {
+  const cv::Rect roi(options.require<int>("x"), options.require<int>("y"),
+                     options.require<int>("width"),
+                     options.require<int>("height"));
+  if (roi.x < 0 || roi.y < 0 || roi.width <= 0 || roi.height <= 0) {
+    throw pontoon::utils::Exception(
+        "The crop element needs a non-empty region at positive coordinates.");
+  }
+  auto warned = std::make_shared<std::atomic<bool>>(false);
+  return [roi, warned](Pipeline::Frame &frame) {
+    const auto image = frame.image;
+    if (roi.x + roi.width > image->cols || roi.y + roi.height > image->rows) {
+      if (!warned->exchange(true)) {
+        std::cerr << "Dropping images, the crop region " << roi
+                  << " is not inside the image (" << image->cols << "x"
+                  << image->rows << ")" << std::endl;
+      }
+      return false;
+    }
+    // Mats mapped from shared memory do not own their pixels, so the view
+    // keeps the full image and with it the slot lease alive
+    frame.image = boost::shared_ptr<cv::Mat>(
+        new cv::Mat((*image)(roi)), [image](cv::Mat *view) { delete view; });
+    return true;
+  };
+}
+
+Step publishStep(Options &options) {
+  const auto uri = options.require<std::string>("uri");
+  const auto encoding = options.get<std::string>("encoding", "none");
+  ImageEncoding::Parameters parameters;
+  parameters.jpeg_quality = options.get<int>("jpeg-quality", -1);
+  parameters.png_compression = options.get<int>("png-compression", -1);
+  parameters.compression.level = options.get<int>("compression-level", 1);
+  auto out = std::make_shared<pontoon::io::rst::EncodingImageInformer>(
+      uri, encoding, 1., 1., options.get<size_t>("threads", 0),
+      options.get<size_t>("in-flight", 0), parameters);
+  return [out](Pipeline::Frame &frame) {
+    out->publish(frame.image, frame.causes, frame.trace);
+    return true;
+  };
+}
+
+} // namespace
+
+/// runs a step on its own thread, fed through a bounded queue
+class Pipeline::Stage {
+public:
+  Stage(const std::string &name, Step step, size_t queue_size,
+        OverflowPolicy::Type overflow, FrameSubject &input)
+      : _Name(name), _Step(step), _Processed(0), _Rejected(0),
+        _Connection(input.connect_async(
+            [this](Frame frame) { this->process(frame); }, queue_size,
+            overflow)) {}
+
+  /// finishes the queued frames
+  ~Stage() { _Connection.disconnect(); }
+
+  FrameSubject &output() { return _Output; }
+
+  Statistics statistics() const {
+    Statistics statistics;
+    statistics.element = _Name;
+    statistics.processed = _Processed;
+    statistics.dropped = _Rejected + _Connection.dropped();
+    return statistics;
+  }
+
+private:
+  void process(Frame &frame) {
+    bool passed = false;
+    try {
+      passed = _Step(frame);
+    } catch (const std::exception &e) {
+      std::cerr << "Error in the " << _Name << " element: " << e.what()
+                << std::endl;
+    }
+    if (passed) {
+      ++_Processed;
+      _Output.notify(frame);
+    } else {
+      ++_Rejected;
+    }
+  }
+
+  const std::string _Name;
+  Step _Step;
+  FrameSubject _Output;
+  std::atomic<size_t> _Processed;
+  std::atomic<size_t> _Rejected;
+  utils::AsyncConnection<Frame> _Connection;
+};
+
+std::vector<Pipeline::Element>
+Pipeline::parse(const std::string &description) {
+  std::vector<Element> elements;
+  std::stringstream lines(description);
+  std::string line;
+  while (std::getline(lines, line)) {
+    line = line.substr(0, line.find('#'));
+    std::stringstream parts(line);
+    std::string part;
+    while (std::getline(parts, part, '|')) {
+      std::stringstream words(part);
+      Element element;
+      if (!(words >> element.name)) {
+        continue;
+      }
+      std::string option;
+      while (words >> option) {
+        auto equals = option.find('=');
+        if (equals == std::string::npos || equals == 0) {
+          throw utils::Exception("Expected key=value instead of " + option +
+                                 " in the " + element.name + " element.");
+        }
+        element.options[option.substr(0, equals)] = option.substr(equals + 1);
+      }
+      elements.push_back(element);
+    }
+  }
+  return elements;
+}
+
+Pipeline::Pipeline(const std::vector<Element> &elements) : _Received(0) {
+  if (elements.size() < 2 || elements.front().name != "listen" ||
+      elements.back().name != "publish") {
+    throw utils::Exception("A pipeline starts with a listen element and ends "
+                           "with a publish element.");
+  }
+  FrameSubject *input = &_Frames;
+  for (size_t i = 1; i < elements.size(); ++i) {
+    const auto &element = elements[i];
+    Options options(element);
+    const auto queue_size = options.get<size_t>("queue", 2);
+    const auto overflow = OverflowPolicy::stringToType(
+        options.get<std::string>("overflow", "drop-oldest"));
+    Step step;
+    if (element.name == "scale") {
+      step = scaleStep(options);
+    } else if (element.name == "crop") {
+      step = cropStep(options);
+    } else if (element.name == "publish" && i + 1 == elements.size()) {
+      step = publishStep(options);
+    } else {
+      throw utils::Exception("The element " + element.name +
+                             " cannot be used here.");
+    }
+    options.checkUsed();
+    _Stages.emplace_back(
+        new Stage(element.name, step, queue_size, overflow, *input));
+    input = &_Stages.back()->output();
+  }
+
+  // the source starts last, so frames only arrive at a complete pipeline
+  Options options(elements.front());
+  const auto uri = options.require<std::string>("uri");
+  const auto threads = options.get<size_t>("threads", 0);
+  const auto reduction = options.get<int>("reduction", 1);
+  if (options.flag("compressed", false)) {
+    _Source = std::make_shared<rst::ListenerCVImageRstCompressedImage>(
+        uri, std::max<size_t>(threads, 1));
+  } else {
+    _Source =
+        std::make_shared<rst::CombinedCVImageListener>(uri, threads, reduction);
+  }
+  options.checkUsed();
+  _SourceConnection = _Source->connect([this](rst::EventData<cv::Mat> data) {
+    ++_Received;
+    _Frames.notify(
+        Frame{data.data(), {data.id()}, Trace::follow(*data.event())});
+  });
+}
+
+Pipeline::~Pipeline() {
+  _SourceConnection.disconnect();
+  _Source.reset();
+  // upstream stages first, so every stage finishes its queue before its
+  // successor stops
+  for (auto &stage : _Stages) {
+    stage.reset();
+  }
+}
+
+std::vector<Pipeline::Statistics> Pipeline::statistics() const {
+  std::vector<Statistics> statistics(1);
+  statistics.front().element = "listen";
+  statistics.front().processed = _Received;
+  for (const auto &stage : _Stages) {
+    statistics.push_back(stage->statistics());
+  }
+  return statistics;
+}
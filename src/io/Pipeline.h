@@ -0,0 +1,112 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/Pipeline.h                                      **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include "io/Cause.h"
+#include "io/rst/Listener.h"
+#include "io/rst/Trace.h"
+#include "utils/Subject.h"
+#include <atomic>
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <memory>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+namespace pontoon {
+namespace io {
+
+/**
+ * Runs a chain of image processing elements in one process, so co-located
+ * stages pass cv::Mat pointers instead of publishing and decoding every
+ * frame via rsb.
+ *
+ * A pipeline is described by elements separated by '|' or newlines. Every
+ * element is a name followed by key=value options, '#' comments out the
+ * rest of a line:
+ *
+ *   listen uri=/video/encoded threads=2 | scale width=640 |
+ *   crop x=0 y=0 width=640 height=360 | publish uri=/video/crop encoding=jpg
+ *
+ * The first element is a listen source, the last one a publish sink, in
+ * between any number of scale and crop elements:
+ *
+ * - listen uri= [threads=0] [reduction=1] [compressed=false]
+ *   receives raw and encoded images (see CombinedCVImageListener) or
+ *   losslessly compressed ones and decodes them with threads workers.
+ * - scale [scale-width=1] [scale-height=1] [width=0] [height=0]
+ *   [interpolation=auto] like encode-images.
+ * - crop x= y= width= height= passes a view of the region without copying,
+ *   images not containing the region are dropped.
+ * - publish uri= [encoding=none] [threads=0] [in-flight=0]
+ *   [jpeg-quality=-1] [png-compression=-1] [compression-level=1] encodes
+ *   and publishes through EncodingImageInformer.
+ *
+ * Every element after the source runs on its own thread and is fed through
+ * a bounded queue of queue= frames (default 2), overflow= chooses the
+ * OverflowPolicy (default drop-oldest). Frames carry the rst::Trace of their
+ * received event, published events continue it.
+ */
+class Pipeline {
+public:
+  struct Frame {
+    boost::shared_ptr<cv::Mat> image;
+    pontoon::io::Causes causes;
+    rst::Trace trace;
+  };
+
+  struct Element {
+    std::string name;
+    std::map<std::string, std::string> options;
+  };
+
+  struct Statistics {
+    std::string element;
+    /// frames passed on by the element
+    size_t processed = 0;
+    /// frames dropped by the element or its queue
+    size_t dropped = 0;
+  };
+
+  /// parses a description as documented above
+  static std::vector<Element> parse(const std::string &description);
+
+  /// starts processing, throws utils::Exception on invalid elements
+  Pipeline(const std::vector<Element> &elements);
+
+  /// stops the source and finishes the queued frames
+  ~Pipeline();
+
+  /// one entry per element in pipeline order
+  std::vector<Statistics> statistics() const;
+
+private:
+  class Stage;
+  typedef utils::Subject<rst::EventData<cv::Mat>> ImageSubject;
+  typedef utils::Subject<Frame> FrameSubject;
+
+  ImageSubject::Ptr _Source;
+  ImageSubject::Connection _SourceConnection;
+  FrameSubject _Frames;
+  std::atomic<size_t> _Received;
+  std::vector<std::unique_ptr<Stage>> _Stages;
+};
+
+} // namespace io
+} // namespace pontoon
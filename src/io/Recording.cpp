@@ -0,0 +1,311 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/Recording.cpp                                   **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/Recording.h"
+#include "utils/Exception.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using pontoon::io::Recording;
+using pontoon::io::RecordingReader;
+using pontoon::io::RecordingWriter;
+
+const size_t Recording::ALIGNMENT;
+const size_t Recording::FRAME_HEADER_SIZE;
+
+namespace {
+
+const char FILE_MAGIC[4] = {'P', 'N', 'T', 'R'};
+const char FRAME_MAGIC[4] = {'P', 'N', 'T', 'F'};
+const char INDEX_MAGIC[4] = {'P', 'N', 'T', 'I'};
+const uint32_t VERSION = 1;
+const size_t FILE_HEADER_SIZE = 24;
+/// offset, timestamp and sequence of a frame
+const size_t INDEX_ENTRY_SIZE = 24;
+/// index offset, frame count, magic and version
+const size_t FOOTER_SIZE = 24;
+
+template <typename T>
+void writeLittleEndian(unsigned char *out, T value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    out[i] = (unsigned char)(uint64_t(value) >> (8 * i));
+  }
+}
+
+uint64_t readLittleEndian(const unsigned char *in, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= uint64_t(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+uint64_t roundUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+std::string systemError() { return std::strerror(errno); }
+
+} // namespace
+
+RecordingWriter::RecordingWriter(const std::string &file_name,
+                                 const BlockWriter::Parameters &parameters)
+    : _File(file_name, parameters) {
+  unsigned char header[FILE_HEADER_SIZE] = {};
+  std::memcpy(header, FILE_MAGIC, 4);
+  writeLittleEndian(header + 4, VERSION, 4);
+  writeLittleEndian(header + 8, Recording::ALIGNMENT, 4);
+  writeLittleEndian(header + 12, Recording::FRAME_HEADER_SIZE, 4);
+  _File.append(header, sizeof(header));
+  _File.pad(Recording::ALIGNMENT);
+}
+
+RecordingWriter::~RecordingWriter() {
+  try {
+    close();
+  } catch (const std::exception &e) {
+    std::cerr << "Could not close recording: " << e.what() << std::endl;
+  }
+}
+
+void RecordingWriter::write(const cv::Mat &image,
+                            const Recording::FrameInfo &info) {
+  if (_Closed) {
+    throw utils::Exception("The recording is closed");
+  }
+  const size_t row = image.cols * image.elemSize();
+  const uint64_t size = uint64_t(row) * image.rows;
+  const Entry entry{_File.offset(), info.timestamp, info.sequence};
+
+  unsigned char header[Recording::FRAME_HEADER_SIZE] = {};
+  std::memcpy(header, FRAME_MAGIC, 4);
+  writeLittleEndian(header + 4, Recording::FRAME_HEADER_SIZE, 4);
+  writeLittleEndian(header + 8, info.sequence, 8);
+  writeLittleEndian(header + 16, info.timestamp, 8);
+  writeLittleEndian(header + 24, info.key, 8);
+  writeLittleEndian(header + 32, image.cols, 4);
+  writeLittleEndian(header + 36, image.rows, 4);
+  writeLittleEndian(header + 40, image.type(), 4);
+  writeLittleEndian(header + 48, size, 8);
+  _File.append(header, sizeof(header));
+  if (image.isContinuous()) {
+    _File.append(image.data, size);
+  } else {
+    for (int r = 0; r < image.rows; ++r) {
+      _File.append(image.ptr(r), row);
+    }
+  }
+  _File.pad(Recording::ALIGNMENT);
+  _Index.push_back(entry);
+}
+
+void RecordingWriter::close() {
+  if (_Closed) {
+    return;
+  }
+  _Closed = true;
+  const uint64_t index_offset = _File.offset();
+  unsigned char entry[INDEX_ENTRY_SIZE];
+  for (const Entry &e : _Index) {
+    writeLittleEndian(entry, e.offset, 8);
+    writeLittleEndian(entry + 8, e.timestamp, 8);
+    writeLittleEndian(entry + 16, e.sequence, 8);
+    _File.append(entry, sizeof(entry));
+  }
+  unsigned char footer[FOOTER_SIZE];
+  writeLittleEndian(footer, index_offset, 8);
+  writeLittleEndian(footer + 8, _Index.size(), 8);
+  std::memcpy(footer + 16, INDEX_MAGIC, 4);
+  writeLittleEndian(footer + 20, VERSION, 4);
+  _File.append(footer, sizeof(footer));
+  _File.close();
+}
+
+size_t RecordingWriter::frames() const { return _Index.size(); }
+
+uint64_t RecordingWriter::bytes() const { return _File.offset(); }
+
+pontoon::io::BlockWriter::Statistics RecordingWriter::statistics() const {
+  return _File.statistics();
+}
+
+RecordingReader::RecordingReader(const std::string &file_name) {
+  const int file = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file < 0) {
+    throw utils::Exception("Could not open recording " + file_name + ": " +
+                           systemError());
+  }
+  struct stat status;
+  if (::fstat(file, &status) != 0) {
+    ::close(file);
+    throw utils::Exception("Could not stat recording " + file_name + ": " +
+                           systemError());
+  }
+  _Size = status.st_size;
+  if (_Size < FILE_HEADER_SIZE) {
+    ::close(file);
+    throw utils::Exception(file_name + " is not a recording");
+  }
+  void *data = ::mmap(nullptr, _Size, PROT_READ, MAP_SHARED, file, 0);
+  ::close(file);
+  if (data == MAP_FAILED) {
+    throw utils::Exception("Could not map recording " + file_name + ": " +
+                           systemError());
+  }
+  _Data = static_cast<const unsigned char *>(data);
+  try {
+    if (std::memcmp(_Data, FILE_MAGIC, 4) != 0) {
+      throw utils::Exception(file_name + " is not a recording");
+    }
+    const uint32_t version = readLittleEndian(_Data + 4, 4);
+    if (version != VERSION) {
+      throw utils::Exception("Unsupported recording version " +
+                             std::to_string(version));
+    }
+    _Alignment = readLittleEndian(_Data + 8, 4);
+    if (_Alignment < Recording::FRAME_HEADER_SIZE ||
+        (_Alignment & (_Alignment - 1)) != 0) {
+      throw utils::Exception("Corrupt recording header");
+    }
+    readIndex();
+    if (!_Indexed) {
+      scanFrames();
+    }
+  } catch (...) {
+    ::munmap(const_cast<unsigned char *>(_Data), _Size);
+    throw;
+  }
+}
+
+RecordingReader::~RecordingReader() {
+  ::munmap(const_cast<unsigned char *>(_Data), _Size);
+}
+
+size_t RecordingReader::size() const { return _Index.size(); }
+
+RecordingReader::Frame RecordingReader::frame(size_t index) const {
+  const uint64_t offset = _Index.at(index).offset;
+  const unsigned char *header = _Data + offset;
+  if (std::memcmp(header, FRAME_MAGIC, 4) != 0) {
+    throw utils::Exception("Corrupt frame header of frame " +
+                           std::to_string(index));
+  }
+  Frame frame;
+  frame.info.sequence = readLittleEndian(header + 8, 8);
+  frame.info.timestamp = readLittleEndian(header + 16, 8);
+  frame.info.key = readLittleEndian(header + 24, 8);
+  const int width = readLittleEndian(header + 32, 4);
+  const int height = readLittleEndian(header + 36, 4);
+  const int type = readLittleEndian(header + 40, 4);
+  const uint64_t size = readLittleEndian(header + 48, 8);
+  if (width < 0 || height < 0 ||
+      uint64_t(width) * height * CV_ELEM_SIZE(type) != size) {
+    throw utils::Exception("Frame " + std::to_string(index) +
+                           " does not match its size and type");
+  }
+  // the index only guarantees that the header is inside the file
+  if (size > _Size - offset - Recording::FRAME_HEADER_SIZE) {
+    throw utils::Exception("Frame " + std::to_string(index) +
+                           " exceeds the recording");
+  }
+  // the mapping is read-only, the pixels must not be written
+  frame.image =
+      cv::Mat(height, width, type,
+              const_cast<unsigned char *>(header) +
+                  Recording::FRAME_HEADER_SIZE);
+  return frame;
+}
+
+uint64_t RecordingReader::timestamp(size_t index) const {
+  return _Index.at(index).timestamp;
+}
+
+size_t RecordingReader::find(uint64_t timestamp) const {
+  // frames of several sources are not sorted by timestamp, so no bisection
+  auto found = std::find_if(
+      _Index.begin(), _Index.end(),
+      [timestamp](const Entry &entry) { return entry.timestamp >= timestamp; });
+  return found - _Index.begin();
+}
+
+void RecordingReader::prefetch(size_t index, size_t count) const {
+  if (index >= _Index.size() || count == 0) {
+    return;
+  }
+  const size_t last = std::min(_Index.size(), index + count) - 1;
+  const uint64_t page = ::sysconf(_SC_PAGESIZE);
+  const uint64_t begin = _Index[index].offset / page * page;
+  // the last frame is prefetched up to the end of the file
+  const uint64_t end =
+      last + 1 < _Index.size() ? _Index[last + 1].offset : _Size;
+  ::madvise(const_cast<unsigned char *>(_Data) + begin, end - begin,
+            MADV_WILLNEED);
+}
+
+bool RecordingReader::indexed() const { return _Indexed; }
+
+void RecordingReader::readIndex() {
+  if (_Size < FILE_HEADER_SIZE + FOOTER_SIZE) {
+    return;
+  }
+  const unsigned char *footer = _Data + _Size - FOOTER_SIZE;
+  if (std::memcmp(footer + 16, INDEX_MAGIC, 4) != 0) {
+    return;
+  }
+  const uint64_t index_offset = readLittleEndian(footer, 8);
+  const uint64_t count = readLittleEndian(footer + 8, 8);
+  if (index_offset > _Size - FOOTER_SIZE ||
+      (_Size - FOOTER_SIZE - index_offset) != count * INDEX_ENTRY_SIZE) {
+    return;
+  }
+  std::vector<Entry> index;
+  index.reserve(count);
+  for (uint64_t i = 0; i < count; ++i) {
+    const unsigned char *entry = _Data + index_offset + i * INDEX_ENTRY_SIZE;
+    const uint64_t offset = readLittleEndian(entry, 8);
+    if (offset + Recording::FRAME_HEADER_SIZE > index_offset) {
+      return;
+    }
+    index.push_back(Entry{offset, readLittleEndian(entry + 8, 8)});
+  }
+  _Index.swap(index);
+  _Indexed = true;
+}
+
+void RecordingReader::scanFrames() {
+  uint64_t offset = roundUp(FILE_HEADER_SIZE, _Alignment);
+  while (offset + Recording::FRAME_HEADER_SIZE <= _Size) {
+    const unsigned char *header = _Data + offset;
+    if (std::memcmp(header, FRAME_MAGIC, 4) != 0) {
+      break;
+    }
+    const uint64_t size = readLittleEndian(header + 48, 8);
+    const uint64_t end = offset + Recording::FRAME_HEADER_SIZE + size;
+    if (end > _Size || end < offset) {
+      // the last frame was cut off
+      break;
+    }
+    _Index.push_back(Entry{offset, readLittleEndian(header + 16, 8)});
+    offset = roundUp(end, _Alignment);
+  }
+}
@@ -0,0 +1,145 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/Recording.h                                     **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include "io/BlockWriter.h"
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+namespace pontoon {
+namespace io {
+
+/**
+ * A self-describing file of raw frames.
+ *
+ * The file starts with a header naming the format version and the
+ * alignment. Every frame record starts at a multiple of the alignment with
+ * a 64 byte header holding sequence number, timestamp, key, width, height,
+ * cv type and data size, followed by the tightly packed pixel rows.
+ * RecordingWriter::close appends an index of all frames and a footer
+ * pointing at it. Recordings without index, for example of a killed
+ * recorder, are indexed by scanning the frame headers when opened.
+ *
+ * All fields are little endian.
+ */
+struct Recording {
+  /// frame records start at multiples of this
+  static const size_t ALIGNMENT = 4096;
+  static const size_t FRAME_HEADER_SIZE = 64;
+
+  struct FrameInfo {
+    /// the rsb sequence number of the frame
+    uint64_t sequence = 0;
+    /// microseconds since epoch, usually the rsb create time
+    uint64_t timestamp = 0;
+    /// identifies the source of a frame, e.g. a hash of its scope
+    uint64_t key = 0;
+  };
+};
+
+/**
+ * Writes recordings through a BlockWriter, so they are written with large
+ * block writes and optionally from a dedicated I/O thread. Not thread-safe.
+ */
+class RecordingWriter {
+public:
+  RecordingWriter(const std::string &file_name,
+                  const BlockWriter::Parameters &parameters =
+                      BlockWriter::Parameters());
+  /// closes the recording, errors are printed to std::cerr
+  ~RecordingWriter();
+
+  void write(const cv::Mat &image, const Recording::FrameInfo &info);
+
+  /// writes index and footer, further writes throw
+  void close();
+
+  size_t frames() const;
+  /// the size of the recording so far
+  uint64_t bytes() const;
+
+  BlockWriter::Statistics statistics() const;
+
+private:
+  struct Entry {
+    uint64_t offset;
+    uint64_t timestamp;
+    uint64_t sequence;
+  };
+
+  BlockWriter _File;
+  bool _Closed = false;
+  std::vector<Entry> _Index;
+};
+
+/**
+ * Memory maps a recording for random access. Frames are cv::Mat headers on
+ * the mapped file and stay valid as long as the reader lives.
+ */
+class RecordingReader {
+public:
+  struct Frame {
+    Recording::FrameInfo info;
+    cv::Mat image;
+  };
+
+  RecordingReader(const std::string &file_name);
+  ~RecordingReader();
+
+  RecordingReader(const RecordingReader &) = delete;
+  RecordingReader &operator=(const RecordingReader &) = delete;
+
+  size_t size() const;
+  Frame frame(size_t index) const;
+
+  /// the timestamp of a frame without touching its pixels
+  uint64_t timestamp(size_t index) const;
+
+  /**
+   * the index of the first frame recorded at or after timestamp, size() if
+   * there is none. Scans all frames, recordings of several sources are not
+   * sorted by timestamp.
+   */
+  size_t find(uint64_t timestamp) const;
+
+  /// asks the kernel to read the frames [index, index + count) ahead
+  void prefetch(size_t index, size_t count = 1) const;
+
+  /// false when the index was rebuilt by scanning the frames
+  bool indexed() const;
+
+private:
+  struct Entry {
+    uint64_t offset;
+    uint64_t timestamp;
+  };
+
+  void readIndex();
+  void scanFrames();
+
+  const unsigned char *_Data = nullptr;
+  size_t _Size = 0;
+  size_t _Alignment = Recording::ALIGNMENT;
+  bool _Indexed = false;
+  std::vector<Entry> _Index;
+};
+
+} // namespace io
+} // namespace pontoon
@@ -0,0 +1,378 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/SharedMemory.cpp                                **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/SharedMemory.h"
+#include "utils/Exception.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using pontoon::io::SharedMemory;
+using pontoon::io::SharedMemoryReader;
+using pontoon::io::SharedMemorySegment;
+using pontoon::io::SharedMemoryWriter;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "shared memory slots need address-free 64 bit atomics");
+
+namespace {
+
+const char MAGIC[4] = {'P', 'N', 'T', 'S'};
+const uint32_t VERSION = 1;
+const size_t HEADER_SIZE = 64;
+const size_t SLOT_STATE_SIZE = 64;
+const size_t PAGE_SIZE = 4096;
+/// readers value of a slot while the writer fills it
+const uint32_t WRITING = 0xffffffff;
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t slots;
+  uint32_t reserved;
+  uint64_t slot_size;
+  uint64_t data_offset;
+};
+
+struct SlotState {
+  /**
+   * The sequence of the frame in the slot in the upper and the number of its
+   * mapped frames or WRITING in the lower half. Both change together, so
+   * readers only pin and unpin the frame they mapped.
+   */
+  std::atomic<uint64_t> lease;
+  /// steady clock nanoseconds of the latest pin
+  std::atomic<int64_t> pinned_at;
+};
+
+static_assert(sizeof(Header) <= HEADER_SIZE, "header too large");
+static_assert(sizeof(SlotState) <= SLOT_STATE_SIZE, "slot state too large");
+
+uint64_t roundUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+std::string systemError() { return std::strerror(errno); }
+
+int64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t makeLease(uint32_t sequence, uint32_t readers) {
+  return uint64_t(sequence) << 32 | readers;
+}
+
+uint32_t sequenceOf(uint64_t lease) { return lease >> 32; }
+
+uint32_t readersOf(uint64_t lease) { return uint32_t(lease); }
+
+/// frames only stay valid while they are pinned
+bool pin(SlotState &state, uint64_t sequence) {
+  // refreshed before the count rises, so the writer never sees the new pin
+  // with an expired lease
+  state.pinned_at.store(now());
+  auto lease = state.lease.load();
+  do {
+    if (sequence == 0 || sequenceOf(lease) != sequence ||
+        readersOf(lease) >= WRITING - 1) {
+      return false;
+    }
+  } while (!state.lease.compare_exchange_weak(lease, lease + 1));
+  return true;
+}
+
+void unpin(SlotState &state, uint64_t sequence) {
+  auto lease = state.lease.load();
+  do {
+    // the writer took the slot after the lease timed out
+    if (sequenceOf(lease) != sequence || readersOf(lease) == 0 ||
+        readersOf(lease) == WRITING) {
+      return;
+    }
+  } while (!state.lease.compare_exchange_weak(lease, lease - 1));
+}
+
+} // namespace
+
+/// a mapped segment, the creator unlinks it
+class pontoon::io::SharedMemorySegment {
+public:
+  /// creates a new segment
+  SharedMemorySegment(const std::string &name, size_t slots, size_t slot_size)
+      : _Name(name), _Owner(true) {
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      throw utils::Exception("Cannot create shared memory " + name + ": " +
+                             systemError());
+    }
+    const uint64_t data_offset =
+        roundUp(HEADER_SIZE + slots * SLOT_STATE_SIZE, PAGE_SIZE);
+    _Size = data_offset + slots * slot_size;
+    if (ftruncate(fd, _Size) != 0) {
+      auto error = systemError();
+      close(fd);
+      shm_unlink(name.c_str());
+      throw utils::Exception("Cannot resize shared memory " + name + ": " +
+                             error);
+    }
+    mapFile(fd);
+    auto header = new (_Data) Header();
+    std::memcpy(header->magic, MAGIC, 4);
+    header->version = VERSION;
+    header->slots = slots;
+    header->slot_size = slot_size;
+    header->data_offset = data_offset;
+    for (size_t i = 0; i < slots; ++i) {
+      auto slot = new (_Data + HEADER_SIZE + i * SLOT_STATE_SIZE) SlotState();
+      slot->lease.store(makeLease(0, 0));
+      slot->pinned_at.store(0);
+    }
+  }
+
+  /// maps an existing segment or returns nullptr when it was unlinked
+  static std::shared_ptr<SharedMemorySegment> open(const std::string &name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0 && errno == ENOENT) {
+      return nullptr;
+    }
+    if (fd < 0) {
+      throw utils::Exception("Cannot open shared memory " + name + ": " +
+                             systemError());
+    }
+    return std::shared_ptr<SharedMemorySegment>(
+        new SharedMemorySegment(name, fd));
+  }
+
+  ~SharedMemorySegment() {
+    munmap(_Data, _Size);
+    if (_Owner) {
+      shm_unlink(_Name.c_str());
+    }
+  }
+
+  const std::string &name() const { return _Name; }
+  size_t slots() const { return header().slots; }
+  size_t slotSize() const { return header().slot_size; }
+
+  SlotState &state(size_t slot) {
+    return *reinterpret_cast<SlotState *>(_Data + HEADER_SIZE +
+                                          slot * SLOT_STATE_SIZE);
+  }
+
+  unsigned char *data(size_t slot) {
+    return _Data + header().data_offset + slot * header().slot_size;
+  }
+
+private:
+  /// maps the opened segment fd
+  SharedMemorySegment(const std::string &name, int fd)
+      : _Name(name), _Owner(false) {
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+      auto error = systemError();
+      close(fd);
+      throw utils::Exception("Cannot stat shared memory " + name + ": " +
+                             error);
+    }
+    _Size = status.st_size;
+    if (_Size < HEADER_SIZE) {
+      close(fd);
+      throw utils::Exception("Shared memory " + name + " is too small.");
+    }
+    mapFile(fd);
+    if (std::memcmp(header().magic, MAGIC, 4) != 0 ||
+        header().version != VERSION ||
+        header().data_offset + uint64_t(header().slots) * header().slot_size >
+            _Size) {
+      munmap(_Data, _Size);
+      throw utils::Exception("Shared memory " + name +
+                             " is not a pontoon frame ring.");
+    }
+  }
+
+  const Header &header() const {
+    return *reinterpret_cast<const Header *>(_Data);
+  }
+
+  void mapFile(int fd) {
+    void *data =
+        mmap(nullptr, _Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    auto error = systemError();
+    close(fd);
+    if (data == MAP_FAILED) {
+      if (_Owner) {
+        shm_unlink(_Name.c_str());
+      }
+      throw utils::Exception("Cannot map shared memory " + _Name + ": " +
+                             error);
+    }
+    _Data = static_cast<unsigned char *>(data);
+  }
+
+  const std::string _Name;
+  const bool _Owner;
+  size_t _Size;
+  unsigned char *_Data;
+};
+
+SharedMemoryWriter::SharedMemoryWriter(
+    const SharedMemory::Parameters &parameters)
+    : _Parameters(parameters), _Generation(0), _Next(0), _Dropped(0) {
+  if (parameters.slots == 0) {
+    throw utils::Exception("Shared memory needs at least one slot.");
+  }
+  std::stringstream prefix;
+  prefix << "/pontoon-" << getpid() << "-" << std::hex
+         << std::random_device()() << "-";
+  _Prefix = prefix.str();
+}
+
+SharedMemoryWriter::~SharedMemoryWriter() = default;
+
+bool SharedMemoryWriter::write(const cv::Mat &image,
+                               SharedMemory::Descriptor &descriptor) {
+  const size_t row_size = image.cols * image.elemSize();
+  const size_t size = row_size * image.rows;
+  if (_Retired &&
+      std::chrono::steady_clock::now() - _RetiredAt >=
+          _Parameters.lease_timeout) {
+    _Retired.reset();
+  }
+  if (!_Segment || _Segment->slotSize() < size) {
+    // a new segment for larger frames, readers keep mapped old frames and
+    // the old segment stays linked for descriptors still on their way
+    _Retired = std::move(_Segment);
+    _RetiredAt = std::chrono::steady_clock::now();
+    _Segment.reset(new SharedMemorySegment(
+        _Prefix + std::to_string(_Generation++), _Parameters.slots,
+        roundUp(std::max(size, _Parameters.slot_size), PAGE_SIZE)));
+    _Next = 0;
+  }
+
+  const auto timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           _Parameters.lease_timeout)
+                           .count();
+  for (size_t i = 0; i < _Segment->slots(); ++i) {
+    const size_t slot = (_Next + i) % _Segment->slots();
+    auto &state = _Segment->state(slot);
+    auto lease = state.lease.load();
+    if (readersOf(lease) > 0 && now() - state.pinned_at.load() < timeout) {
+      continue;
+    }
+    // stale readers of the previous frame cannot unpin the next one
+    uint32_t sequence = sequenceOf(lease) + 1;
+    if (sequence == 0) {
+      sequence = 1;
+    }
+    if (!state.lease.compare_exchange_strong(
+            lease, makeLease(sequenceOf(lease), WRITING))) {
+      continue;
+    }
+    unsigned char *out = _Segment->data(slot);
+    if (image.isContinuous()) {
+      std::memcpy(out, image.data, size);
+    } else {
+      for (int row = 0; row < image.rows; ++row) {
+        std::memcpy(out + row * row_size, image.ptr(row), row_size);
+      }
+    }
+    descriptor.segment = _Segment->name();
+    descriptor.slot = slot;
+    descriptor.sequence = sequence;
+    descriptor.rows = image.rows;
+    descriptor.cols = image.cols;
+    descriptor.type = image.type();
+    // the lease of the first pin starts with the frame
+    state.pinned_at.store(now());
+    state.lease.store(makeLease(sequence, 0));
+    _Next = slot + 1;
+    return true;
+  }
+  ++_Dropped;
+  return false;
+}
+
+size_t SharedMemoryWriter::dropped() const { return _Dropped; }
+
+SharedMemoryReader::SharedMemoryReader() = default;
+
+SharedMemoryReader::~SharedMemoryReader() = default;
+
+boost::shared_ptr<cv::Mat>
+SharedMemoryReader::read(const SharedMemory::Descriptor &descriptor) {
+  auto segment = map(descriptor.segment);
+  if (!segment) {
+    // the writer replaced the segment and unlinked it
+    return boost::shared_ptr<cv::Mat>();
+  }
+  const size_t size = size_t(descriptor.rows) * descriptor.cols *
+                      CV_ELEM_SIZE(descriptor.type);
+  if (descriptor.slot >= segment->slots() || descriptor.rows < 0 ||
+      descriptor.cols < 0 || size > segment->slotSize()) {
+    throw utils::Exception("Invalid frame descriptor for shared memory " +
+                           descriptor.segment + ".");
+  }
+  auto &state = segment->state(descriptor.slot);
+  const auto sequence = descriptor.sequence;
+  if (!pin(state, sequence)) {
+    return boost::shared_ptr<cv::Mat>();
+  }
+  return boost::shared_ptr<cv::Mat>(
+      new cv::Mat(descriptor.rows, descriptor.cols, descriptor.type,
+                  segment->data(descriptor.slot)),
+      [segment, &state, sequence](cv::Mat *image) {
+        delete image;
+        unpin(state, sequence);
+      });
+}
+
+std::shared_ptr<SharedMemorySegment>
+SharedMemoryReader::map(const std::string &name) {
+  std::lock_guard<std::mutex> lock(_Mutex);
+  auto segment = _Segments.find(name);
+  if (segment != _Segments.end()) {
+    return segment->second;
+  }
+  // a writer replaces its segment when frames grow, forget the old one,
+  // its frames keep it mapped as long as they are alive
+  const auto writer = name.substr(0, name.rfind('-') + 1);
+  for (auto it = _Segments.begin(); it != _Segments.end();) {
+    if (it->first.compare(0, writer.size(), writer) == 0) {
+      it = _Segments.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  // segments of writers that are gone
+  if (_Segments.size() >= 8) {
+    _Segments.clear();
+  }
+  auto mapped = SharedMemorySegment::open(name);
+  if (mapped) {
+    _Segments[name] = mapped;
+  }
+  return mapped;
+}
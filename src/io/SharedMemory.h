@@ -0,0 +1,129 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/SharedMemory.h                                  **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <string>
+
+namespace pontoon {
+namespace io {
+
+class SharedMemorySegment;
+
+/**
+ * A ring of frame slots in a POSIX shared memory segment, so co-located
+ * processes exchange frames without copying them through a transport.
+ *
+ * The writer copies a frame into a free slot and hands out a small
+ * Descriptor, which is sent to the readers by other means (see
+ * rst::SharedMemoryConverter). Readers map the segment named by the
+ * descriptor and wrap the slot in a cv::Mat without copying. The slot stays
+ * pinned until the last copy of that Mat is released, the writer skips
+ * pinned slots and drops frames when all slots are pinned. All readers of a
+ * frame share its pixels, they must not modify them.
+ *
+ * Slots pinned for longer than lease_timeout are considered leaked by a
+ * crashed reader and are reused, frames must be released before that. Slot
+ * states are lock-free atomics in the segment. Segments are only accessible
+ * by processes of the same user.
+ */
+struct SharedMemory {
+  struct Parameters {
+    /// number of frame slots
+    size_t slots = 4;
+    /// minimum slot size in bytes, slots grow with the frames
+    size_t slot_size = 0;
+    std::chrono::milliseconds lease_timeout = std::chrono::seconds(10);
+  };
+
+  struct Descriptor {
+    /// the name of the segment, passed to shm_open
+    std::string segment;
+    uint32_t slot = 0;
+    /// identifies the frame written to the slot, never 0
+    uint64_t sequence = 0;
+    int32_t rows = 0;
+    int32_t cols = 0;
+    /// the cv type
+    int32_t type = 0;
+  };
+};
+
+/// Owns and writes a shared memory segment. Not thread-safe.
+class SharedMemoryWriter {
+public:
+  SharedMemoryWriter(const SharedMemory::Parameters &parameters =
+                         SharedMemory::Parameters());
+  /// unlinks the segments, mapped readers keep their frames
+  ~SharedMemoryWriter();
+
+  /**
+   * Copies image into a free slot and returns its descriptor. Returns false
+   * when all slots are pinned by readers.
+   */
+  bool write(const cv::Mat &image, SharedMemory::Descriptor &descriptor);
+
+  /// frames dropped because all slots were pinned
+  size_t dropped() const;
+
+private:
+  const SharedMemory::Parameters _Parameters;
+  /// shared by the names of all segments of the writer, readers use it to
+  /// forget replaced segments
+  std::string _Prefix;
+  size_t _Generation;
+  std::unique_ptr<SharedMemorySegment> _Segment;
+  /// the segment replaced by _Segment, unlinked after the lease timeout
+  std::unique_ptr<SharedMemorySegment> _Retired;
+  std::chrono::steady_clock::time_point _RetiredAt;
+  size_t _Next;
+  size_t _Dropped;
+};
+
+/**
+ * Maps the frames of descriptors. Segments stay mapped while frames of them
+ * are alive. Thread-safe.
+ */
+class SharedMemoryReader {
+public:
+  SharedMemoryReader();
+  ~SharedMemoryReader();
+
+  /**
+   * The frame of descriptor or an empty pointer when the slot was already
+   * overwritten or the segment is gone. Throws utils::Exception when the
+   * segment cannot be mapped.
+   */
+  boost::shared_ptr<cv::Mat> read(const SharedMemory::Descriptor &descriptor);
+
+private:
+  std::shared_ptr<SharedMemorySegment> map(const std::string &segment);
+
+  std::mutex _Mutex;
+  /// the latest mapped segments, writers replace theirs when frames grow
+  std::map<std::string, std::shared_ptr<SharedMemorySegment>> _Segments;
+};
+
+} // namespace io
+} // namespace pontoon
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "io/Cause.h"
+#include "io/rst/Trace.h"
 #include "utils/RsbHelpers.h"
 #include "utils/Subject.h"
 #include <rsb/Factory.h>
@@ -42,15 +43,27 @@ public:
   virtual ~Informer() {}
 
   virtual void publish(DataPtr data, const pontoon::io::Causes &causes) {
+    _Informer->publish(createEvent(data, causes));
+  }
+
+  /// publishes data with the stamps of trace
+  virtual void publish(DataPtr data, const pontoon::io::Causes &causes,
+                       const Trace &trace) {
+    auto event = createEvent(data, causes);
+    trace.apply(*event);
+    _Informer->publish(event);
+  }
+
+private:
+  rsb::EventPtr createEvent(DataPtr data, const pontoon::io::Causes &causes) {
     auto event = _Informer->createEvent();
     for (auto cause : causes) {
       event->addCause(cause);
     }
     event->setData(data);
-    _Informer->publish(event);
+    return event;
   }
 
-private:
   typename rsb::Informer<RST>::Ptr _Informer;
 };
 
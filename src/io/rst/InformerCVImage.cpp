@@ -17,43 +17,182 @@
 
 #include "InformerCVImage.h"
 #include "Informer.h"
+#include "convert/CompressRstImage.h"
 #include "convert/ConvertRstImageOpenCV.h"
+#include "convert/ScaleEncodeImageOpenCV.h"
 #include "convert/ScaleImageOpenCV.h"
+#ifdef PONTOON_WITH_TURBOJPEG
+#include "convert/ConvertRstImageTurboJpeg.h"
+#endif
 #include "utils/Exception.h"
+#include <iostream>
 #include <rst/vision/EncodedImage.pb.h>
 #include <rst/vision/EncodedImageCollection.pb.h>
 #include <rst/vision/Images.pb.h>
 
 using pontoon::io::rst::EncodingImageInformer;
 using pontoon::io::rst::EncodingMultiImageInformer;
+using pontoon::io::rst::Trace;
+using pontoon::convert::Compression;
+using pontoon::convert::CompressRstImage;
+using pontoon::convert::ImageEncoding;
 
 EncodingImageInformer::EncodingImageInformer(const std::string &uri,
                                              const std::string &encoding,
                                              double scale_width,
-                                             double scale_height) {
-  auto scale = std::make_shared<pontoon::convert::ScaleImageOpenCV>(
-      scale_width, scale_height);
+                                             double scale_height,
+                                             size_t encode_threads,
+                                             size_t max_in_flight,
+                                             const ImageEncoding::Parameters
+                                                 &parameters)
+    : EncodingImageInformer(uri, encoding,
+                            pontoon::convert::ScaleImageOpenCV(scale_width,
+                                                               scale_height),
+                            encode_threads, max_in_flight, parameters) {}
+
+EncodingImageInformer::EncodingImageInformer(
+    const std::string &uri, const std::string &encoding,
+    const pontoon::convert::ScaleImageOpenCV &scaler, size_t encode_threads,
+    size_t max_in_flight, const ImageEncoding::Parameters &parameters) {
   if (encoding == "none") {
+    auto scale = std::make_shared<pontoon::convert::ScaleImageOpenCV>(scaler);
     auto out = std::make_shared<InformerCVImage>(uri);
-    _callback = [scale, out](DataPtr image, const Causes &causes) {
-      out->publish(scale->scale(image), causes);
+    _encode = [scale, out](DataPtr image, const Causes &causes,
+                           Trace trace) {
+      auto scaled = scale->scale(image);
+      trace.stamp(Trace::scaled);
+      return [out, scaled, causes, trace]() {
+        out->publish(scaled, causes, trace);
+      };
+    };
+  } else if (encoding == "zlib" || encoding == "zstd" || encoding == "lz4") {
+    auto compression = parameters.compression;
+    compression.backend = Compression::stringToBackend(encoding);
+    auto compress = std::make_shared<CompressRstImage>(compression);
+    auto scale = std::make_shared<pontoon::convert::ScaleImageOpenCV>(scaler);
+    auto out = std::make_shared<Informer<::rst::vision::Image>>(uri);
+    // compressors carry state from frame to frame, so compression runs in
+    // the ordered publish step and is parallelized over bands instead
+    _encode = [scale, compress, out](DataPtr image, const Causes &causes,
+                                     Trace trace) {
+      auto scaled = scale->scale(image);
+      trace.stamp(Trace::scaled);
+      return [compress, out, scaled, causes, trace]() mutable {
+        CompressRstImage::CompressedImagePtr compressed;
+        try {
+          compressed = compress->compress(*scaled);
+        } catch (const std::exception &e) {
+          std::cerr << "Skipping image: " << e.what() << std::endl;
+          return;
+        }
+        trace.stamp(Trace::encoded);
+        out->publish(compressed, causes, trace);
+      };
+    };
+  } else if (encoding == "jpg-turbo") {
+#ifdef PONTOON_WITH_TURBOJPEG
+    pontoon::convert::TurboJpeg::Parameters turbo;
+    if (parameters.jpeg_quality >= 0) {
+      turbo.quality = parameters.jpeg_quality;
+    } else {
+      // same default as OpenCV
+      turbo.quality = 95;
+    }
+    turbo.fast_dct = parameters.jpeg_fast_dct;
+    turbo.subsampling = pontoon::convert::TurboJpeg::stringToSubsampling(
+        parameters.jpeg_subsampling);
+    auto encode =
+        std::make_shared<pontoon::convert::EncodeRstVisionImageTurboJpeg>(
+            turbo);
+    auto scale = std::make_shared<pontoon::convert::ScaleImageOpenCV>(scaler);
+    auto out = std::make_shared<Informer<::rst::vision::EncodedImage>>(uri);
+    _encode = [scale, encode, out](DataPtr image, const Causes &causes,
+                                   Trace trace) {
+      auto scaled = scale->scale(image);
+      trace.stamp(Trace::scaled);
+      auto encoded = encode->encode(scaled);
+      trace.stamp(Trace::encoded);
+      return [out, encoded, causes, trace]() {
+        out->publish(encoded, causes, trace);
+      };
     };
+#else
+    throw pontoon::utils::Exception(
+        "The jpg-turbo encoding needs pontoon built with BUILD_WITH_TURBOJPEG");
+#endif
   } else {
     const auto encoder =
         pontoon::convert::ImageEncoding::stringToType(encoding);
 
     auto out = std::make_shared<Informer<::rst::vision::EncodedImage>>(uri);
     auto compress =
-        std::make_shared<pontoon::convert::EncodeRstVisionImage>(encoder);
-    _callback = [scale, compress, out](DataPtr image, const Causes &causes) {
-      out->publish(compress->encode(scale->scale(image)), causes);
+        std::make_shared<pontoon::convert::ScaleEncodeRstVisionImage>(
+            scaler, encoder, parameters);
+    // scaling and encoding are fused, so only encoded is stamped
+    _encode = [compress, out](DataPtr image, const Causes &causes,
+                              Trace trace) {
+      auto encoded = compress->encode(image);
+      trace.stamp(Trace::encoded);
+      return [out, encoded, causes, trace]() {
+        out->publish(encoded, causes, trace);
+      };
     };
   }
+  if (encode_threads > 0) {
+    if (max_in_flight == 0) {
+      max_in_flight = 2 * encode_threads;
+    }
+    auto encode = _encode;
+    _pool.reset(new Pool(encode_threads, max_in_flight,
+                         [encode](Job job) {
+                           return EncodedJob{
+                               encode(job.image, job.causes, job.trace),
+                               job.received};
+                         },
+                         [this](EncodedJob job) { this->finish(job); }));
+  }
+}
+
+EncodingImageInformer::~EncodingImageInformer() {
+  // publish pending images while the statistics are still alive
+  _pool.reset();
 }
 
 void EncodingImageInformer::publish(EncodingImageInformer::DataPtr data,
                                     const pontoon::io::Causes &causes) {
-  _callback(data, causes);
+  publish(data, causes, Trace());
+}
+
+void EncodingImageInformer::publish(EncodingImageInformer::DataPtr data,
+                                    const pontoon::io::Causes &causes,
+                                    const Trace &trace) {
+  auto received = Clock::now();
+  {
+    std::lock_guard<std::mutex> lock(_statistics_mutex);
+    ++_statistics.received;
+  }
+  if (_pool) {
+    if (!_pool->submit(Job{data, causes, trace, received})) {
+      std::lock_guard<std::mutex> lock(_statistics_mutex);
+      ++_statistics.dropped;
+    }
+  } else {
+    finish(EncodedJob{_encode(data, causes, trace), received});
+  }
+}
+
+void EncodingImageInformer::finish(const EncodedJob &job) {
+  job.publish();
+  auto latency = Clock::now() - job.received;
+  std::lock_guard<std::mutex> lock(_statistics_mutex);
+  ++_statistics.published;
+  _statistics.total_latency += latency;
+  _statistics.max_latency = std::max(_statistics.max_latency, latency);
+}
+
+EncodingImageInformer::Statistics EncodingImageInformer::statistics() const {
+  std::lock_guard<std::mutex> lock(_statistics_mutex);
+  return _statistics;
 }
 
 EncodingMultiImageInformer::EncodingMultiImageInformer(
@@ -17,12 +17,20 @@
 
 #pragma once
 
+#include "convert/ConvertRstImageOpenCV.h"
+#include "convert/ScaleImageOpenCV.h"
 #include "io/Cause.h"
-#include "utils/CvHelpers.h"
+#include "io/SharedMemory.h"
+#include "io/rst/MatConverter.h"
+#include "io/rst/SharedMemoryTransport.h"
+#include "io/rst/Trace.h"
+#include "utils/OrderedWorkerPool.h"
 #include "utils/RsbHelpers.h"
 #include "utils/Subject.h"
 #include <boost/make_shared.hpp>
-#include <opencv2/core/core_c.h>
+#include <chrono>
+#include <mutex>
+#include <opencv2/core.hpp>
 #include <rsb/Factory.h>
 #include <rsb/Handler.h>
 #include <rsb/Listener.h>
@@ -32,6 +40,12 @@ namespace pontoon {
 namespace io {
 namespace rst {
 
+/**
+ * Publishes raw images as rst::vision::Images through MatConverter. With a
+ * shm uri (see SharedMemoryTransport) frames are written to shared memory
+ * and only their descriptors are published, frames are dropped while all
+ * slots are held by receivers.
+ */
 class InformerCVImage {
 public:
   typedef std::shared_ptr<InformerCVImage> Ptr;
@@ -39,40 +53,160 @@ public:
   typedef boost::shared_ptr<DataType> DataPtr;
 
   InformerCVImage(const std::string &uri) {
-    _Informer = utils::rsbhelpers::createInformer<IplImage>(uri);
+    if (SharedMemoryTransport::selected(uri)) {
+      SharedMemoryTransport::registerConverter();
+      _Shared.reset(
+          new SharedMemoryWriter(SharedMemoryTransport::parameters(uri)));
+      _SharedInformer =
+          utils::rsbhelpers::createInformer<SharedMemory::Descriptor>(uri);
+    } else {
+      MatConverter::registerConverter();
+      _Informer = utils::rsbhelpers::createInformer<cv::Mat>(uri);
+    }
   }
 
   virtual ~InformerCVImage() {}
 
   virtual void publish(DataPtr data, const pontoon::io::Causes &causes) {
-    auto event = _Informer->createEvent();
+    auto event = createEvent(data, causes);
+    if (event) {
+      send(event);
+    }
+  }
+
+  /// publishes data with the stamps of trace
+  virtual void publish(DataPtr data, const pontoon::io::Causes &causes,
+                       const Trace &trace) {
+    auto event = createEvent(data, causes);
+    if (event) {
+      trace.apply(*event);
+      send(event);
+    }
+  }
+
+private:
+  rsb::EventPtr createEvent(DataPtr data, const pontoon::io::Causes &causes) {
+    rsb::EventPtr event;
+    if (_Shared) {
+      auto descriptor = boost::make_shared<SharedMemory::Descriptor>();
+      {
+        std::lock_guard<std::mutex> lock(_SharedMutex);
+        if (!_Shared->write(*data, *descriptor)) {
+          return event;
+        }
+      }
+      event = _SharedInformer->createEvent();
+      event->setData(descriptor);
+    } else {
+      event = _Informer->createEvent();
+      event->setData(data);
+    }
     for (auto cause : causes) {
       event->addCause(cause);
     }
-    event->setData(pontoon::utils::cvhelpers::asIplImagePtr(data));
-    _Informer->publish(event);
+    return event;
   }
 
-private:
-  typename rsb::Informer<IplImage>::Ptr _Informer;
+  void send(rsb::EventPtr event) {
+    if (_Shared) {
+      _SharedInformer->publish(event);
+    } else {
+      _Informer->publish(event);
+    }
+  }
+
+  typename rsb::Informer<cv::Mat>::Ptr _Informer;
+  std::mutex _SharedMutex;
+  std::unique_ptr<SharedMemoryWriter> _Shared;
+  typename rsb::Informer<SharedMemory::Descriptor>::Ptr _SharedInformer;
 };
 
+/**
+ * Scales, encodes and publishes images.
+ *
+ * With encode_threads == 0 every image is processed in the calling thread.
+ * Otherwise scaling and encoding run on encode_threads workers while
+ * publishing happens in the order of the publish calls. At most
+ * max_in_flight images (default: two per thread) are processed at the same
+ * time, publish drops images beyond that.
+ *
+ * The encodings zlib, zstd and lz4 publish losslessly compressed
+ * rst::vision::Images (see convert::CompressRstImage) instead of
+ * rst::vision::EncodedImages. They compress in publishing order using the
+ * band threads of parameters.compression.
+ *
+ * The encoding jpg-turbo encodes jpegs through libjpeg-turbo when pontoon is
+ * built with BUILD_WITH_TURBOJPEG.
+ *
+ * Published events carry the scaled, encoded and published stamps of a
+ * Trace. Pass the trace of the incoming event to publish to continue it.
+ */
 class EncodingImageInformer {
 public:
   typedef std::shared_ptr<EncodingImageInformer> Ptr;
   typedef cv::Mat DataType;
   typedef boost::shared_ptr<DataType> DataPtr;
+  typedef std::chrono::steady_clock Clock;
+
+  struct Statistics {
+    /// images handed to publish
+    size_t received = 0;
+    /// images published
+    size_t published = 0;
+    /// images dropped because max_in_flight was reached
+    size_t dropped = 0;
+    /// sum and maximum of the time between publish call and rsb publish
+    Clock::duration total_latency = Clock::duration::zero();
+    Clock::duration max_latency = Clock::duration::zero();
+  };
 
   EncodingImageInformer(const std::string &uri,
                         const std::string &encoding = "none",
-                        double scale_width = 1., double scale_height = 1.);
+                        double scale_width = 1., double scale_height = 1.,
+                        size_t encode_threads = 0, size_t max_in_flight = 0,
+                        const pontoon::convert::ImageEncoding::Parameters
+                            &parameters =
+                                pontoon::convert::ImageEncoding::Parameters());
+
+  EncodingImageInformer(const std::string &uri, const std::string &encoding,
+                        const pontoon::convert::ScaleImageOpenCV &scale,
+                        size_t encode_threads = 0, size_t max_in_flight = 0,
+                        const pontoon::convert::ImageEncoding::Parameters
+                            &parameters =
+                                pontoon::convert::ImageEncoding::Parameters());
 
-  virtual ~EncodingImageInformer() {}
+  virtual ~EncodingImageInformer();
 
   virtual void publish(DataPtr data, const pontoon::io::Causes &causes);
 
+  virtual void publish(DataPtr data, const pontoon::io::Causes &causes,
+                       const Trace &trace);
+
+  Statistics statistics() const;
+
 private:
-  std::function<void(DataPtr, pontoon::io::Causes)> _callback;
+  typedef std::function<void()> PublishStep;
+
+  struct Job {
+    DataPtr image;
+    pontoon::io::Causes causes;
+    Trace trace;
+    Clock::time_point received;
+  };
+
+  struct EncodedJob {
+    PublishStep publish;
+    Clock::time_point received;
+  };
+
+  typedef pontoon::utils::OrderedWorkerPool<Job, EncodedJob> Pool;
+
+  void finish(const EncodedJob &job);
+
+  std::function<PublishStep(DataPtr, pontoon::io::Causes, Trace)> _encode;
+  std::unique_ptr<Pool> _pool;
+  mutable std::mutex _statistics_mutex;
+  Statistics _statistics;
 };
 
 class EncodingMultiImageInformer {
@@ -95,7 +95,11 @@ public:
   Listener(const std::string &uri, bool filter_subscopes = false)
       : _Type(rsc::runtime::typeName(typeid(RST))) {
     utils::rsbhelpers::register_rst<RST>();
-    _Listener = utils::rsbhelpers::createListener(uri);
+    // other converters may share the wire schema of RST
+    auto config = utils::rsbhelpers::selectConverter(
+        utils::rsbhelpers::parseConfig(uri),
+        "." + RST::descriptor()->full_name(), _Type);
+    _Listener = utils::rsbhelpers::createListener(uri, config);
     _Listener->addFilter(
         rsb::filter::FilterPtr(rsb::filter::TypeFilter::createForType<RST>()));
     if (filter_subscopes) {
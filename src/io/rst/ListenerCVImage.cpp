@@ -17,27 +17,52 @@
 
 #include "io/rst/ListenerCVImage.h"
 #include "convert/ConvertRstImageOpenCV.h"
-#include "utils/CvHelpers.h"
+#include "io/rst/MatConverter.h"
+#include "io/rst/SharedMemoryTransport.h"
+#include "io/rst/Trace.h"
+#ifdef PONTOON_WITH_TURBOJPEG
+#include "convert/ConvertRstImageTurboJpeg.h"
+#endif
+#include <iostream>
+#include <map>
 #include <rsb/filter/TypeFilter.h>
 #include <rst/vision/EncodedImage.pb.h>
 #include <rst/vision/Image.pb.h>
 
 using pontoon::io::rst::ListenerCVImageRstImage;
 using pontoon::io::rst::ListenerCVImageRstEncodedImage;
+using pontoon::io::rst::ListenerCVImageRstCompressedImage;
 using pontoon::io::rst::ListenerCVImageRstEncodedImageCollection;
 using pontoon::io::rst::CombinedCVImageListener;
 using pontoon::io::rst::EventData;
+using pontoon::io::rst::MatConverter;
+using pontoon::io::rst::SharedMemoryTransport;
+using pontoon::io::rst::Trace;
 using rsb::filter::FilterPtr;
 using rsb::filter::TypeFilter;
 
-const std::string IPL_IMAGE_TYPE_STRING = rsc::runtime::typeName<IplImage>();
 const std::string MAT_IMAGE_TYPE_STRING = rsc::runtime::typeName<cv::Mat>();
 
 ListenerCVImageRstImage::ListenerCVImageRstImage(const std::string &uri) {
-  _Listener = pontoon::utils::rsbhelpers::createListener(uri);
-  _Listener->addFilter(FilterPtr(new TypeFilter(IPL_IMAGE_TYPE_STRING)));
-  _Handler = boost::make_shared<rsb::EventFunctionHandler>(
-      boost::bind(&ListenerCVImageRstImage::handle, this, _1));
+  if (SharedMemoryTransport::selected(uri)) {
+    SharedMemoryTransport::registerConverter();
+    _Shared.reset(new SharedMemoryReader());
+    _Listener = pontoon::utils::rsbhelpers::createListener(uri);
+    _Listener->addFilter(FilterPtr(new TypeFilter(
+        rsc::runtime::typeName<pontoon::io::SharedMemory::Descriptor>())));
+    _Handler = boost::make_shared<rsb::EventFunctionHandler>(
+        boost::bind(&ListenerCVImageRstImage::handleShared, this, _1));
+  } else {
+    MatConverter::registerConverter();
+    // the rst::vision::Image converter shares the wire schema
+    auto config = pontoon::utils::rsbhelpers::selectConverter(
+        pontoon::utils::rsbhelpers::parseConfig(uri),
+        MatConverter::wireSchema(), MAT_IMAGE_TYPE_STRING);
+    _Listener = pontoon::utils::rsbhelpers::createListener(uri, config);
+    _Listener->addFilter(FilterPtr(new TypeFilter(MAT_IMAGE_TYPE_STRING)));
+    _Handler = boost::make_shared<rsb::EventFunctionHandler>(
+        boost::bind(&ListenerCVImageRstImage::handle, this, _1));
+  }
   _Listener->addHandler(_Handler);
 }
 
@@ -46,33 +71,135 @@ ListenerCVImageRstImage::~ListenerCVImageRstImage() {
 }
 
 void ListenerCVImageRstImage::handle(rsb::EventPtr data) {
-  auto iplimagePtr = boost::static_pointer_cast<IplImage>(data->getData());
+  // MatConverter already deserialized the pixels, the copy only keeps the
+  // stamp off the event rsb handed in
   rsb::EventPtr event(new rsb::Event(*data));
-  event->setData(pontoon::utils::cvhelpers::asMatPtr(iplimagePtr));
+  Trace::stamp(*event, Trace::decoded);
+  notify(EventData<cv::Mat>(event));
+}
+
+void ListenerCVImageRstImage::handleShared(rsb::EventPtr data) {
+  auto descriptor =
+      boost::static_pointer_cast<pontoon::io::SharedMemory::Descriptor>(
+          data->getData());
+  boost::shared_ptr<cv::Mat> image;
+  try {
+    image = _Shared->read(*descriptor);
+  } catch (const std::exception &e) {
+    std::cerr << "Skipping image: " << e.what() << std::endl;
+    return;
+  }
+  if (!image) {
+    // the publisher already reused the slot
+    return;
+  }
+  rsb::EventPtr event(new rsb::Event(*data));
+  event->setData(image);
   event->setType(MAT_IMAGE_TYPE_STRING);
+  Trace::stamp(*event, Trace::decoded);
   notify(EventData<cv::Mat>(event));
 }
 
 ListenerCVImageRstEncodedImage::ListenerCVImageRstEncodedImage(
-    const std::string &uri)
+    const std::string &uri, size_t decode_threads, size_t reorder_window,
+    int reduction)
     : _Listener(uri, false) {
-  _Connection =
-      _Listener.connect([this](EventData<::rst::vision::EncodedImage> data) {
-        rsb::EventPtr event(new rsb::Event(*data.event()));
-        convert::DecodeRstVisionEncodedImage decoder;
-        event->setData(decoder.decode(data.data()));
-        event->setType(MAT_IMAGE_TYPE_STRING);
-        notify(EventData<cv::Mat>(event));
-      });
+  // fail on construction instead of on the first image
+  convert::DecodeRstVisionEncodedImage(0, reduction);
+  if (decode_threads == 0) {
+    _Connection = _Listener.connect(
+        [this, reduction](EventData<::rst::vision::EncodedImage> data) {
+          notify(EventData<cv::Mat>(decode(data, reduction)));
+        });
+  } else {
+    if (reorder_window == 0) {
+      reorder_window = 2 * decode_threads;
+    }
+    _Pool.reset(new DecodePool(
+        decode_threads, reorder_window,
+        [reduction](EventData<::rst::vision::EncodedImage> data) {
+          return decode(data, reduction);
+        },
+        [this](rsb::EventPtr event) { notify(EventData<cv::Mat>(event)); }));
+    _Connection =
+        _Listener.connect([this](EventData<::rst::vision::EncodedImage> data) {
+          _Pool->submit(data);
+        });
+  }
 }
 
 ListenerCVImageRstEncodedImage::~ListenerCVImageRstEncodedImage() {
   _Connection.disconnect();
+  // finish pending decodes while this subject is still alive
+  _Pool.reset();
+}
+
+rsb::EventPtr ListenerCVImageRstEncodedImage::decode(
+    EventData<::rst::vision::EncodedImage> data, int reduction) {
+  // one decoder per thread and reduction keeps its recycled buffers between
+  // frames. emplace would construct a decoder before looking up the key, so
+  // decoders are only created on a miss.
+#ifdef PONTOON_WITH_TURBOJPEG
+  thread_local std::map<int, convert::DecodeRstVisionEncodedImageTurboJpeg>
+      decoders;
+  auto found = decoders.find(reduction);
+  if (found == decoders.end()) {
+    found = decoders
+                .emplace(std::piecewise_construct,
+                         std::forward_as_tuple(reduction),
+                         std::forward_as_tuple(reduction))
+                .first;
+  }
+  auto &decoder = found->second;
+#else
+  thread_local std::map<int, convert::DecodeRstVisionEncodedImage> decoders;
+  auto found = decoders.find(reduction);
+  if (found == decoders.end()) {
+    found = decoders
+                .emplace(std::piecewise_construct,
+                         std::forward_as_tuple(reduction),
+                         std::forward_as_tuple(2, reduction))
+                .first;
+  }
+  auto &decoder = found->second;
+#endif
+  rsb::EventPtr event(new rsb::Event(*data.event()));
+  event->setData(decoder.decode(data.data()));
+  event->setType(MAT_IMAGE_TYPE_STRING);
+  Trace::stamp(*event, Trace::decoded);
+  return event;
+}
+
+ListenerCVImageRstCompressedImage::ListenerCVImageRstCompressedImage(
+    const std::string &uri, size_t decompress_threads)
+    : _Listener(uri, false) {
+  convert::Compression::Parameters parameters;
+  parameters.threads = decompress_threads;
+  _Decompress.reset(new convert::CompressRstImage(parameters));
+  _Connection = _Listener.connect([this](EventData<::rst::vision::Image> data) {
+    rsb::EventPtr event(new rsb::Event(*data.event()));
+    try {
+      event->setData(_Decompress->decompressMat(*data.data()));
+    } catch (const std::exception &e) {
+      std::cerr << "Skipping image: " << e.what() << std::endl;
+      return;
+    }
+    event->setType(MAT_IMAGE_TYPE_STRING);
+    Trace::stamp(*event, Trace::decoded);
+    notify(EventData<cv::Mat>(event));
+  });
+}
+
+ListenerCVImageRstCompressedImage::~ListenerCVImageRstCompressedImage() {
+  _Connection.disconnect();
 }
 
-CombinedCVImageListener::CombinedCVImageListener(const std::string &uri)
+CombinedCVImageListener::CombinedCVImageListener(const std::string &uri,
+                                                 size_t decode_threads,
+                                                 int reduction)
     : pontoon::utils::CompositeSubject<EventData<cv::Mat>>(
-          {Ptr(new ListenerCVImageRstEncodedImage(uri)),
+          {Ptr(new ListenerCVImageRstEncodedImage(uri, decode_threads, 0,
+                                                  reduction)),
            Ptr(new ListenerCVImageRstImage(uri))}) {}
 
 ListenerCVImageRstEncodedImageCollection::
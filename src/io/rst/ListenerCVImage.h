@@ -17,22 +17,32 @@
 
 #pragma once
 
+#include "convert/CompressRstImage.h"
+#include "io/SharedMemory.h"
 #include "io/rst/Listener.h"
+#include "utils/OrderedWorkerPool.h"
 #include "utils/RsbHelpers.h"
 #include "utils/Subject.h"
 #include <boost/make_shared.hpp>
-#include <opencv2/core/core_c.h>
+#include <opencv2/core.hpp>
 #include <rsb/Factory.h>
 #include <rsb/Handler.h>
 #include <rsb/Listener.h>
 #include <rsc/runtime/TypeStringTools.h>
 #include <rst/vision/EncodedImage.pb.h>
 #include <rst/vision/EncodedImageCollection.pb.h>
+#include <rst/vision/Image.pb.h>
 
 namespace pontoon {
 namespace io {
 namespace rst {
 
+/**
+ * Receives raw images, deserialized by MatConverter. With a shm uri (see
+ * SharedMemoryTransport) it maps the frames of received descriptors from
+ * shared memory instead, frames that were overwritten before they arrived
+ * are skipped.
+ */
 class ListenerCVImageRstImage
     : public pontoon::utils::Subject<EventData<cv::Mat>> {
 public:
@@ -43,27 +53,78 @@ public:
 private:
   rsb::ListenerPtr _Listener;
   rsb::HandlerPtr _Handler;
+  std::unique_ptr<SharedMemoryReader> _Shared;
 
   void handle(rsb::EventPtr data);
+  void handleShared(rsb::EventPtr data);
 };
 
+/**
+ * Decodes received rst::vision::EncodedImages into cv::Mats.
+ *
+ * With decode_threads == 0 images are decoded on the rsb handler thread.
+ * Otherwise they are decoded concurrently by decode_threads workers and
+ * notified in the order they were received. At most reorder_window images
+ * (default: two per thread) are decoded or waiting for their predecessors,
+ * further images are dropped until the window frees up.
+ *
+ * A reduction of 2, 4 or 8 delivers images shrunk by that factor, which lets
+ * preview consumers decode JPEGs at a fraction of the full cost.
+ */
 class ListenerCVImageRstEncodedImage
     : public pontoon::utils::Subject<EventData<cv::Mat>> {
 public:
-  ListenerCVImageRstEncodedImage(const std::string &uri);
+  ListenerCVImageRstEncodedImage(const std::string &uri,
+                                 size_t decode_threads = 0,
+                                 size_t reorder_window = 0, int reduction = 1);
 
   ~ListenerCVImageRstEncodedImage();
 
 private:
   typedef pontoon::io::rst::Listener<::rst::vision::EncodedImage> ListenerType;
+  typedef pontoon::utils::OrderedWorkerPool<
+      EventData<::rst::vision::EncodedImage>, rsb::EventPtr>
+      DecodePool;
+
+  static rsb::EventPtr decode(EventData<::rst::vision::EncodedImage> data,
+                              int reduction);
+
+  std::unique_ptr<DecodePool> _Pool;
+  ListenerType _Listener;
+  ListenerType::Connection _Connection;
+};
+
+/**
+ * Decompresses rst::vision::Images published with the zlib, zstd or lz4
+ * encodings of EncodingImageInformer into cv::Mats. Uncompressed images are
+ * passed on as they are. The bands of a frame are decompressed by
+ * decompress_threads threads.
+ */
+class ListenerCVImageRstCompressedImage
+    : public pontoon::utils::Subject<EventData<cv::Mat>> {
+public:
+  ListenerCVImageRstCompressedImage(const std::string &uri,
+                                    size_t decompress_threads = 1);
+
+  ~ListenerCVImageRstCompressedImage();
+
+private:
+  typedef pontoon::io::rst::Listener<::rst::vision::Image> ListenerType;
+
+  std::unique_ptr<convert::CompressRstImage> _Decompress;
   ListenerType _Listener;
   ListenerType::Connection _Connection;
 };
 
+/**
+ * Receives rst::vision::Images and rst::vision::EncodedImages. The reduction
+ * only applies to encoded images.
+ */
 class CombinedCVImageListener
     : public pontoon::utils::CompositeSubject<EventData<cv::Mat>> {
 public:
-  CombinedCVImageListener(const std::string &uri);
+  CombinedCVImageListener(const std::string &uri, size_t decode_threads = 0,
+                          int reduction = 1);
 
   ~CombinedCVImageListener() = default;
 };
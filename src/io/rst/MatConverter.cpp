@@ -0,0 +1,239 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/rst/MatConverter.cpp                            **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/rst/MatConverter.h"
+#include "utils/Exception.h"
+#include "utils/FramePool.h"
+#include "utils/Metrics.h"
+#include <boost/make_shared.hpp>
+#include <cstring>
+#include <opencv2/core.hpp>
+#include <rsb/converter/Repository.h>
+#include <rsc/runtime/TypeStringTools.h>
+#include <rst/vision/Image.pb.h>
+
+using pontoon::io::rst::MatConverter;
+using pontoon::utils::ConverterMetrics;
+
+namespace {
+
+const uint32_t LENGTH_DELIMITED = 2;
+const uint64_t DATA_TAG =
+    (uint64_t(::rst::vision::Image::kDataFieldNumber) << 3) | LENGTH_DELIMITED;
+/// upper bound of the serialized meta data fields
+const size_t META_DATA_SIZE = 64;
+
+void appendVarint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(char(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(char(value));
+}
+
+/// false on truncated input
+bool readVarint(const std::string &in, size_t &offset, uint64_t &value) {
+  value = 0;
+  for (size_t shift = 0; shift < 64 && offset < in.size(); shift += 7) {
+    const unsigned char byte = in[offset++];
+    value |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Finds the pixel data in a serialized rst::vision::Image and copies all
+ * other fields to meta, so the pixels are only copied once.
+ */
+bool splitData(const std::string &wire, std::string &meta, size_t &data,
+               size_t &data_size) {
+  bool found = false;
+  size_t offset = 0;
+  while (offset < wire.size()) {
+    const size_t field = offset;
+    uint64_t tag = 0;
+    uint64_t length = 0;
+    if (!readVarint(wire, offset, tag)) {
+      return false;
+    }
+    switch (tag & 7) {
+    case 0:
+      if (!readVarint(wire, offset, length)) {
+        return false;
+      }
+      length = 0;
+      break;
+    case 1:
+      length = 8;
+      break;
+    case LENGTH_DELIMITED:
+      if (!readVarint(wire, offset, length)) {
+        return false;
+      }
+      break;
+    case 5:
+      length = 4;
+      break;
+    default:
+      return false;
+    }
+    if (length > wire.size() - offset) {
+      return false;
+    }
+    if (tag == DATA_TAG) {
+      data = offset;
+      data_size = length;
+      found = true;
+    } else {
+      meta.append(wire, field, offset + length - field);
+    }
+    offset += length;
+  }
+  return found;
+}
+
+int cvDepthOf(const ::rst::vision::Image &image) {
+  switch (image.depth()) {
+  case ::rst::vision::Image::DEPTH_8U:
+    return CV_8U;
+  case ::rst::vision::Image::DEPTH_16U:
+    return CV_16U;
+  case ::rst::vision::Image::DEPTH_32F:
+    return CV_32F;
+  default:
+    throw pontoon::utils::Exception(
+        "Cannot deserialize images with rst depth " +
+        std::to_string(image.depth()) + " into a cv::Mat");
+  }
+}
+
+} // namespace
+
+MatConverter::MatConverter()
+    : rsb::converter::Converter<std::string>(rsc::runtime::typeName<cv::Mat>(),
+                                             wireSchema(), true),
+      _Serialized(ConverterMetrics::named("serialize.mat")),
+      _Deserialized(ConverterMetrics::named("deserialize.mat")) {}
+
+std::string MatConverter::serialize(const rsb::AnnotatedData &data,
+                                    std::string &wire) {
+  auto time = ConverterMetrics::Clock::now();
+  const cv::Mat &image = *boost::static_pointer_cast<cv::Mat>(data.second);
+  ::rst::vision::Image meta;
+  meta.set_width(image.cols);
+  meta.set_height(image.rows);
+  meta.set_channels(image.channels());
+  switch (image.depth()) {
+  case CV_8U:
+    meta.set_depth(::rst::vision::Image::DEPTH_8U);
+    break;
+  case CV_16U:
+    meta.set_depth(::rst::vision::Image::DEPTH_16U);
+    break;
+  case CV_32F:
+    meta.set_depth(::rst::vision::Image::DEPTH_32F);
+    break;
+  default:
+    _Serialized.recordError();
+    throw utils::Exception(
+        "Can only serialize 8U, 16U and 32F images, got cv depth " +
+        std::to_string(image.depth()));
+  }
+  if (image.channels() == 1) {
+    meta.set_color_mode(::rst::vision::Image::COLOR_GRAYSCALE);
+  } else if (image.channels() == 3) {
+    meta.set_color_mode(::rst::vision::Image::COLOR_BGR);
+  }
+  meta.set_data_order(::rst::vision::Image::DATA_INTERLEAVED);
+
+  const size_t row_size = image.cols * image.elemSize();
+  const size_t size = row_size * image.rows;
+  wire.clear();
+  wire.reserve(META_DATA_SIZE + size);
+  meta.AppendPartialToString(&wire);
+  appendVarint(wire, DATA_TAG);
+  appendVarint(wire, size);
+  if (image.isContinuous()) {
+    wire.append(reinterpret_cast<const char *>(image.data), size);
+  } else {
+    // ROIs are packed row by row
+    for (int row = 0; row < image.rows; ++row) {
+      wire.append(reinterpret_cast<const char *>(image.ptr(row)), row_size);
+    }
+  }
+  _Serialized.record(size, wire.size(), ConverterMetrics::Clock::now() - time);
+  return getWireSchema();
+}
+
+rsb::AnnotatedData MatConverter::deserialize(const std::string &wire_schema,
+                                             const std::string &wire) {
+  auto time = ConverterMetrics::Clock::now();
+  std::string meta_data;
+  size_t data = 0;
+  size_t size = 0;
+  ::rst::vision::Image meta;
+  if (wire_schema != getWireSchema() ||
+      !splitData(wire, meta_data, data, size) ||
+      !meta.ParsePartialFromString(meta_data)) {
+    _Deserialized.recordError();
+    throw utils::Exception("Cannot deserialize a malformed rst::vision::Image");
+  }
+  const int channels = meta.channels();
+  const int depth = cvDepthOf(meta);
+  if (channels < 1 || channels > CV_CN_MAX ||
+      size_t(meta.width()) * meta.height() * channels * CV_ELEM_SIZE(depth) !=
+          size) {
+    _Deserialized.recordError();
+    throw utils::Exception("The size of the rst::vision::Image data does not "
+                           "match its geometry");
+  }
+  const cv::Size geometry(meta.width(), meta.height());
+  auto image = utils::FramePool::shared().create(
+      geometry, CV_MAKETYPE(depth, channels));
+  const char *pixels = wire.data() + data;
+  if (meta.data_order() == ::rst::vision::Image::DATA_SEPARATE &&
+      channels > 1) {
+    std::vector<cv::Mat> planes;
+    const size_t plane_size = size / channels;
+    for (int channel = 0; channel < channels; ++channel) {
+      planes.emplace_back(geometry, CV_MAKETYPE(depth, 1),
+                          const_cast<char *>(pixels + channel * plane_size));
+    }
+    cv::merge(planes, *image);
+  } else {
+    std::memcpy(image->data, pixels, size);
+  }
+  _Deserialized.record(wire.size(), size,
+                       ConverterMetrics::Clock::now() - time);
+  return rsb::AnnotatedData(getDataType(), image);
+}
+
+std::string MatConverter::wireSchema() {
+  return "." + ::rst::vision::Image::descriptor()->full_name();
+}
+
+void MatConverter::registerConverter() {
+  try {
+    rsb::converter::converterRepository<std::string>()->registerConverter(
+        boost::shared_ptr<MatConverter>(new MatConverter()));
+  } catch (const std::exception &e) {
+    // already available do nothing
+  }
+}
@@ -0,0 +1,65 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/rst/MatConverter.h                              **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include "utils/Metrics.h"
+#include <rsb/converter/Converter.h>
+#include <string>
+
+namespace pontoon {
+namespace io {
+namespace rst {
+
+/**
+ * Serializes cv::Mats as rst::vision::Images and back, replacing the
+ * IplImage converter of rst-converters for raw images.
+ *
+ * Pixels are written straight from the Mat rows into the wire, so ROIs are
+ * sent without cloning them first, and deserialized into buffers of
+ * utils::FramePool without an intermediate rst::vision::Image. Images with
+ * separate channel planes are interleaved on deserialization. 8U, 16U and
+ * 32F depths are supported, color modes are passed on as they are.
+ *
+ * The converter shares its wire schema with the protocol buffer converter of
+ * rst::vision::Image. Listeners therefore select converters explicitly, see
+ * utils::rsbhelpers::selectConverter.
+ */
+class MatConverter : public rsb::converter::Converter<std::string> {
+public:
+  MatConverter();
+
+  std::string serialize(const rsb::AnnotatedData &data,
+                        std::string &wire) override;
+
+  rsb::AnnotatedData deserialize(const std::string &wire_schema,
+                                 const std::string &wire) override;
+
+  /// the wire schema of rst::vision::Image
+  static std::string wireSchema();
+
+  /// registers the converter with rsb if not already done
+  static void registerConverter();
+
+private:
+  utils::ConverterMetrics &_Serialized;
+  utils::ConverterMetrics &_Deserialized;
+};
+
+} // namespace rst
+} // namespace io
+} // namespace pontoon
@@ -0,0 +1,127 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/rst/SharedMemoryTransport.cpp                   **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/rst/SharedMemoryTransport.h"
+#include "utils/Exception.h"
+#include "utils/RsbHelpers.h"
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <rsb/converter/Repository.h>
+#include <rsc/runtime/TypeStringTools.h>
+
+using pontoon::io::SharedMemory;
+using pontoon::io::rst::SharedMemoryConverter;
+using pontoon::io::rst::SharedMemoryTransport;
+
+const std::string SharedMemoryTransport::SCHEME = "shm";
+
+namespace {
+
+const std::string WIRE_SCHEMA = ".pontoon.SharedMemoryDescriptor";
+/// slot, sequence, rows, cols and type, followed by the segment name
+const size_t FIXED_SIZE = 24;
+
+template <typename T>
+void writeLittleEndian(char *out, T value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    out[i] = char(uint64_t(value) >> (8 * i));
+  }
+}
+
+uint64_t readLittleEndian(const char *in, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= uint64_t((unsigned char)in[i]) << (8 * i);
+  }
+  return value;
+}
+
+template <typename T>
+T option(const std::map<std::string, std::string> &options,
+         const std::string &key, T fallback) {
+  auto value = options.find(key);
+  if (value == options.end()) {
+    return fallback;
+  }
+  try {
+    return boost::lexical_cast<T>(value->second);
+  } catch (const boost::bad_lexical_cast &) {
+    throw pontoon::utils::Exception("Invalid shared memory option " + key +
+                                    "=" + value->second);
+  }
+}
+
+} // namespace
+
+bool SharedMemoryTransport::selected(const std::string &uri) {
+  return utils::rsbhelpers::parseScheme(uri) == SCHEME;
+}
+
+SharedMemory::Parameters
+SharedMemoryTransport::parameters(const std::string &uri) {
+  const auto options = utils::rsbhelpers::parseOptions(uri);
+  SharedMemory::Parameters parameters;
+  parameters.slots = option(options, "slots", parameters.slots);
+  parameters.slot_size = option(options, "slot_size", parameters.slot_size);
+  parameters.lease_timeout = std::chrono::milliseconds(
+      option(options, "lease_timeout", parameters.lease_timeout.count()));
+  return parameters;
+}
+
+void SharedMemoryTransport::registerConverter() {
+  try {
+    rsb::converter::converterRepository<std::string>()->registerConverter(
+        boost::shared_ptr<SharedMemoryConverter>(new SharedMemoryConverter()));
+  } catch (const std::exception &e) {
+    // already available do nothing
+  }
+}
+
+SharedMemoryConverter::SharedMemoryConverter()
+    : rsb::converter::Converter<std::string>(
+          rsc::runtime::typeName<SharedMemory::Descriptor>(), WIRE_SCHEMA,
+          true) {}
+
+std::string SharedMemoryConverter::serialize(const rsb::AnnotatedData &data,
+                                             std::string &wire) {
+  const auto &descriptor =
+      *boost::static_pointer_cast<SharedMemory::Descriptor>(data.second);
+  wire.assign(FIXED_SIZE, '\0');
+  writeLittleEndian(&wire[0], descriptor.slot, 4);
+  writeLittleEndian(&wire[4], descriptor.sequence, 8);
+  writeLittleEndian(&wire[12], descriptor.rows, 4);
+  writeLittleEndian(&wire[16], descriptor.cols, 4);
+  writeLittleEndian(&wire[20], descriptor.type, 4);
+  wire += descriptor.segment;
+  return getWireSchema();
+}
+
+rsb::AnnotatedData
+SharedMemoryConverter::deserialize(const std::string &wire_schema,
+                                   const std::string &wire) {
+  if (wire_schema != WIRE_SCHEMA || wire.size() <= FIXED_SIZE) {
+    throw utils::Exception("Invalid shared memory descriptor.");
+  }
+  auto descriptor = boost::make_shared<SharedMemory::Descriptor>();
+  descriptor->slot = readLittleEndian(&wire[0], 4);
+  descriptor->sequence = readLittleEndian(&wire[4], 8);
+  descriptor->rows = int32_t(readLittleEndian(&wire[12], 4));
+  descriptor->cols = int32_t(readLittleEndian(&wire[16], 4));
+  descriptor->type = int32_t(readLittleEndian(&wire[20], 4));
+  descriptor->segment = wire.substr(FIXED_SIZE);
+  return rsb::AnnotatedData(getDataType(), descriptor);
+}
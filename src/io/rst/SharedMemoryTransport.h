@@ -0,0 +1,66 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/rst/SharedMemoryTransport.h                     **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include "io/SharedMemory.h"
+#include <rsb/converter/Converter.h>
+#include <string>
+
+namespace pontoon {
+namespace io {
+namespace rst {
+
+/**
+ * Selects shared memory for raw images with uris like
+ *
+ *   shm:/video/raw?slots=4&transport=socket
+ *
+ * InformerCVImage then writes frames to a SharedMemoryWriter and publishes
+ * only their SharedMemory::Descriptors via rsb, ListenerCVImageRstImage maps
+ * the frames of received descriptors without copying. Descriptors use the
+ * rsb transport named by the transport option, otherwise the configured
+ * default. Shared memory only works between processes of one host.
+ *
+ * Options: slots (default 4), slot_size in bytes (default: the frame size),
+ * lease_timeout in milliseconds (default 10000).
+ */
+struct SharedMemoryTransport {
+  static const std::string SCHEME;
+
+  static bool selected(const std::string &uri);
+  static SharedMemory::Parameters parameters(const std::string &uri);
+
+  /// registers SharedMemoryConverter with rsb if not already done
+  static void registerConverter();
+};
+
+/// Serializes SharedMemory::Descriptors for rsb.
+class SharedMemoryConverter : public rsb::converter::Converter<std::string> {
+public:
+  SharedMemoryConverter();
+
+  std::string serialize(const rsb::AnnotatedData &data,
+                        std::string &wire) override;
+
+  rsb::AnnotatedData deserialize(const std::string &wire_schema,
+                                 const std::string &wire) override;
+};
+
+} // namespace rst
+} // namespace io
+} // namespace pontoon
@@ -0,0 +1,147 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/rst/Trace.cpp                                   **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "io/rst/Trace.h"
+#include "utils/Exception.h"
+#include <algorithm>
+#include <chrono>
+#include <rsb/MetaData.h>
+
+using pontoon::io::rst::Trace;
+
+static const std::string PREFIX = "pontoon.";
+
+static std::string key(size_t hop, Trace::Stage stage) {
+  return PREFIX + std::to_string(hop) + "." + Trace::stageToString(stage);
+}
+
+static size_t lastHop(const std::map<std::pair<size_t, Trace::Stage>,
+                                     uint64_t> &stamps) {
+  return stamps.empty() ? 0 : stamps.rbegin()->first.first;
+}
+
+Trace::Trace() : _Hop(0) {}
+
+Trace Trace::follow(const rsb::Event &event) {
+  Trace trace;
+  trace._Stamps = read(event);
+  trace._Hop = lastHop(trace._Stamps) + 1;
+  return trace;
+}
+
+void Trace::stamp(Stage stage) {
+  _Stamps[std::make_pair(_Hop, stage)] = now();
+}
+
+void Trace::apply(rsb::Event &event) const {
+  auto &meta = event.mutableMetaData();
+  for (const auto &stamp : _Stamps) {
+    meta.setUserTime(key(stamp.first.first, stamp.first.second),
+                     stamp.second);
+  }
+  meta.setUserTime(key(_Hop, published), now());
+}
+
+size_t Trace::hop() const { return _Hop; }
+
+void Trace::stamp(rsb::Event &event, Stage stage) {
+  event.mutableMetaData().setUserTime(key(lastHop(read(event)), stage), now());
+}
+
+std::vector<Trace::Stamp> Trace::stamps(const rsb::Event &event) {
+  std::vector<Stamp> result;
+  for (const auto &stamp : read(event)) {
+    result.push_back(Stamp{stamp.first.first, stamp.first.second,
+                           stamp.second});
+  }
+  return result;
+}
+
+uint64_t Trace::now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+Trace::Stamps Trace::read(const rsb::Event &event) {
+  Stamps stamps;
+  const auto &meta = event.getMetaData();
+  for (const auto &name : meta.userTimeKeys()) {
+    if (name.compare(0, PREFIX.size(), PREFIX) != 0) {
+      continue;
+    }
+    auto dot = name.find('.', PREFIX.size());
+    if (dot == std::string::npos || dot == PREFIX.size()) {
+      continue;
+    }
+    auto hop = name.substr(PREFIX.size(), dot - PREFIX.size());
+    if (!std::all_of(hop.begin(), hop.end(),
+                     [](char c) { return c >= '0' && c <= '9'; })) {
+      continue;
+    }
+    try {
+      auto stage = stringToStage(name.substr(dot + 1));
+      stamps[std::make_pair(std::stoul(hop), stage)] = meta.getUserTime(name);
+    } catch (const std::exception &) {
+      // not ours
+    }
+  }
+  // publishers that do not trace still provide the rsb times of their hop
+  auto hop = lastHop(stamps);
+  if (meta.getSendTime() != 0) {
+    stamps.emplace(std::make_pair(hop, published), meta.getSendTime());
+  }
+  if (meta.getReceiveTime() != 0) {
+    stamps.emplace(std::make_pair(hop, received), meta.getReceiveTime());
+  }
+  return stamps;
+}
+
+std::string Trace::stageToString(Stage stage) {
+  switch (stage) {
+  case scaled:
+    return "scaled";
+  case encoded:
+    return "encoded";
+  case published:
+    return "published";
+  case received:
+    return "received";
+  case decoded:
+    return "decoded";
+  case consumed:
+    return "consumed";
+  }
+  throw utils::Exception("Unknown Trace::Stage (" + std::to_string(stage) +
+                         ").");
+}
+
+Trace::Stage Trace::stringToStage(const std::string &stage) {
+  if (stage == "scaled")
+    return scaled;
+  if (stage == "encoded")
+    return encoded;
+  if (stage == "published")
+    return published;
+  if (stage == "received")
+    return received;
+  if (stage == "decoded")
+    return decoded;
+  if (stage == "consumed")
+    return consumed;
+  throw utils::Exception(std::string("Unknown Trace::Stage: ") + stage);
+}
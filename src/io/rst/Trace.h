@@ -0,0 +1,99 @@
+/********************************************************************
+**                                                                 **
+** File   : src/io/rst/Trace.h                                     **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <rsb/Event.h>
+#include <string>
+#include <vector>
+
+namespace pontoon {
+namespace io {
+namespace rst {
+
+/**
+ * Stamps the time of processing stages into the user times of rsb events, so
+ * the latency of a multi-process pipeline can be broken down per hop.
+ *
+ * A hop is one event on its way from a publisher to its consumers. Stamps
+ * are named "pontoon.<hop>.<stage>" and hold microseconds since epoch. The
+ * publisher of hop h stamps scaled, encoded and published, its consumers
+ * stamp received, decoded and consumed. A process that publishes results of
+ * a received event follows its trace, so the outgoing event carries all
+ * stamps of the incoming one and its own stamps go to hop h + 1.
+ *
+ * Stamps of different hosts are only comparable with synchronized clocks.
+ */
+class Trace {
+public:
+  /// in processing order within a hop
+  enum Stage { scaled, encoded, published, received, decoded, consumed };
+
+  struct Stamp {
+    size_t hop;
+    Stage stage;
+    /// microseconds since epoch
+    uint64_t time;
+  };
+
+  /// a trace starting with hop 0
+  Trace();
+
+  /**
+   * The trace of an event published as a result of event. Events without
+   * stamps get published and received from their rsb send and receive time.
+   */
+  static Trace follow(const rsb::Event &event);
+
+  /// stamps stage of the outgoing hop with the current time
+  void stamp(Stage stage);
+
+  /// stamps published and writes all stamps into the user times of event
+  void apply(rsb::Event &event) const;
+
+  /// the hop stamped by this trace
+  size_t hop() const;
+
+  /// stamps stage of the hop of a received event with the current time
+  static void stamp(rsb::Event &event, Stage stage);
+
+  /**
+   * All stamps of a received event ordered by hop and stage, including its
+   * rsb receive time.
+   */
+  static std::vector<Stamp> stamps(const rsb::Event &event);
+
+  /// microseconds since epoch
+  static uint64_t now();
+
+  static std::string stageToString(Stage stage);
+  static Stage stringToStage(const std::string &stage);
+
+private:
+  typedef std::map<std::pair<size_t, Stage>, uint64_t> Stamps;
+
+  static Stamps read(const rsb::Event &event);
+
+  size_t _Hop;
+  Stamps _Stamps;
+};
+
+} // namespace rst
+} // namespace io
+} // namespace pontoon
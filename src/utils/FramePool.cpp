@@ -0,0 +1,157 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/FramePool.cpp                                **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "utils/FramePool.h"
+#include <boost/make_shared.hpp>
+#include <ostream>
+
+using pontoon::utils::FramePool;
+
+double FramePool::Statistics::hitRate() const {
+  size_t total = hits + misses;
+  return total ? hits / (double)total : 0.;
+}
+
+FramePool::FramePool(size_t max_cached_bytes)
+    : _max_cached_bytes(max_cached_bytes) {}
+
+FramePool::~FramePool() {
+  for (auto &size_class : _free) {
+    for (void *buffer : size_class.second) {
+      cv::fastFree(buffer);
+    }
+  }
+}
+
+FramePool &FramePool::shared() {
+  // leaked on purpose, pooled Mats may be released during static destruction
+  static FramePool *pool = new FramePool();
+  return *pool;
+}
+
+boost::shared_ptr<cv::Mat> FramePool::create() {
+  auto mat = boost::make_shared<cv::Mat>();
+  mat->allocator = this;
+  return mat;
+}
+
+boost::shared_ptr<cv::Mat> FramePool::create(cv::Size size, int type) {
+  auto mat = create();
+  mat->create(size, type);
+  return mat;
+}
+
+FramePool::Statistics FramePool::statistics() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _statistics;
+}
+
+void FramePool::print(std::ostream &out) const {
+  Statistics s = statistics();
+  out << "frame pool: hit rate " << s.hitRate() << " cached "
+      << (s.cached_bytes >> 20) << "MB used " << (s.used_bytes >> 20) << "MB"
+      << std::endl;
+}
+
+size_t FramePool::sizeClass(size_t bytes) {
+  const size_t minimum = 4096;
+  if (bytes <= minimum) {
+    return minimum;
+  }
+  size_t power = minimum;
+  while (power * 2 <= bytes) {
+    power *= 2;
+  }
+  size_t quarter = power / 4;
+  return (bytes + quarter - 1) / quarter * quarter;
+}
+
+void *FramePool::take(size_t bytes) const {
+  size_t size_class = sizeClass(bytes);
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _statistics.used_bytes += size_class;
+    auto it = _free.find(size_class);
+    if (it != _free.end() && !it->second.empty()) {
+      void *buffer = it->second.back();
+      it->second.pop_back();
+      _statistics.cached_bytes -= size_class;
+      ++_statistics.hits;
+      return buffer;
+    }
+    ++_statistics.misses;
+  }
+  return cv::fastMalloc(size_class);
+}
+
+void FramePool::give(void *buffer, size_t bytes) const {
+  size_t size_class = sizeClass(bytes);
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _statistics.used_bytes -= size_class;
+    if (_statistics.cached_bytes + size_class <= _max_cached_bytes) {
+      _free[size_class].push_back(buffer);
+      _statistics.cached_bytes += size_class;
+      return;
+    }
+  }
+  cv::fastFree(buffer);
+}
+
+// mirrors cv::StdMatAllocator apart from where the memory comes from
+cv::UMatData *FramePool::allocate(int dims, const int *sizes, int type,
+                                  void *data, size_t *step,
+                                  AccessFlags /*flags*/,
+                                  cv::UMatUsageFlags /*usageFlags*/) const {
+  size_t total = CV_ELEM_SIZE(type);
+  for (int i = dims - 1; i >= 0; --i) {
+    if (step) {
+      if (data && step[i] != CV_AUTOSTEP) {
+        CV_Assert(total <= step[i]);
+        total = step[i];
+      } else {
+        step[i] = total;
+      }
+    }
+    total *= sizes[i];
+  }
+  cv::UMatData *u = new cv::UMatData(this);
+  u->data = u->origdata = data ? (uchar *)data : (uchar *)take(total);
+  u->size = total;
+  if (data) {
+    u->flags |= cv::UMatData::USER_ALLOCATED;
+  }
+  return u;
+}
+
+bool FramePool::allocate(cv::UMatData *u, AccessFlags /*accessflags*/,
+                         cv::UMatUsageFlags /*usageFlags*/) const {
+  return u != nullptr;
+}
+
+void FramePool::deallocate(cv::UMatData *u) const {
+  if (!u) {
+    return;
+  }
+  CV_Assert(u->urefcount == 0);
+  CV_Assert(u->refcount == 0);
+  if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+    give(u->origdata, u->size);
+    u->origdata = nullptr;
+  }
+  delete u;
+}
@@ -0,0 +1,95 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/FramePool.h                                  **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace pontoon {
+namespace utils {
+
+/**
+ * A cv::MatAllocator that keeps released frame buffers for reuse.
+ *
+ * Buffers are grouped in size classes (quarter steps between powers of two)
+ * so frames of the same or a slightly smaller size can share a buffer. A
+ * buffer returns to the pool when the last cv::Mat referencing it is
+ * released, copies and ROIs of pooled Mats are therefore safe. At most
+ * max_cached_bytes are kept, further releases go back to the system.
+ *
+ * Mats allocated from a pool must not outlive it, use shared() unless the
+ * pool lifetime is obvious.
+ */
+class FramePool : public cv::MatAllocator {
+public:
+  struct Statistics {
+    size_t hits = 0;
+    size_t misses = 0;
+    /// bytes held by the pool for reuse
+    size_t cached_bytes = 0;
+    /// bytes currently used by Mats allocated from the pool
+    size_t used_bytes = 0;
+
+    double hitRate() const;
+  };
+
+  FramePool(size_t max_cached_bytes = size_t(512) << 20);
+  ~FramePool();
+
+  /// the process wide pool used by the pontoon converters, never destroyed
+  static FramePool &shared();
+
+  /// an empty Mat that will allocate from this pool
+  boost::shared_ptr<cv::Mat> create();
+  /// a Mat of the passed geometry backed by a pooled buffer
+  boost::shared_ptr<cv::Mat> create(cv::Size size, int type);
+
+  Statistics statistics() const;
+  void print(std::ostream &out) const;
+
+#if CV_VERSION_MAJOR >= 4
+  typedef cv::AccessFlag AccessFlags;
+#else
+  typedef int AccessFlags;
+#endif
+
+  cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+                         size_t *step, AccessFlags flags,
+                         cv::UMatUsageFlags usageFlags) const override;
+  bool allocate(cv::UMatData *data, AccessFlags accessflags,
+                cv::UMatUsageFlags usageFlags) const override;
+  void deallocate(cv::UMatData *data) const override;
+
+private:
+  static size_t sizeClass(size_t bytes);
+
+  void *take(size_t bytes) const;
+  void give(void *buffer, size_t bytes) const;
+
+  const size_t _max_cached_bytes;
+  mutable std::mutex _mutex;
+  mutable std::map<size_t, std::vector<void *>> _free;
+  mutable Statistics _statistics;
+};
+
+} // namespace utils
+} // namespace pontoon
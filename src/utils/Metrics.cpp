@@ -0,0 +1,114 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/Metrics.cpp                                  **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "utils/Metrics.h"
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+using pontoon::utils::ConverterMetrics;
+
+namespace {
+std::mutex registry_mutex;
+std::map<std::string, std::unique_ptr<ConverterMetrics>> registry;
+
+size_t bucketOf(uint64_t nanoseconds) {
+  size_t bucket = 0;
+  while (nanoseconds > 1 && bucket + 1 < ConverterMetrics::buckets) {
+    nanoseconds >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+}
+
+constexpr size_t ConverterMetrics::buckets;
+
+double ConverterMetrics::Snapshot::ratio() const {
+  return bytes_in ? bytes_out / (double)bytes_in : 0.;
+}
+
+double ConverterMetrics::Snapshot::meanMilliseconds() const {
+  return frames ? total_nanoseconds / (double)frames / 1e6 : 0.;
+}
+
+double ConverterMetrics::Snapshot::quantileMilliseconds(double q) const {
+  uint64_t count = 0;
+  for (auto bucket : histogram) {
+    count += bucket;
+  }
+  uint64_t rank = (uint64_t)(q * count);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets; ++i) {
+    seen += histogram[i];
+    if (seen > rank) {
+      return (uint64_t(1) << (i + 1)) / 1e6;
+    }
+  }
+  return 0.;
+}
+
+void ConverterMetrics::record(size_t bytes_in, size_t bytes_out,
+                              Clock::duration latency) {
+  uint64_t nanoseconds =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+  _frames.fetch_add(1, std::memory_order_relaxed);
+  _bytes_in.fetch_add(bytes_in, std::memory_order_relaxed);
+  _bytes_out.fetch_add(bytes_out, std::memory_order_relaxed);
+  _total_nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+  _histogram[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+ConverterMetrics::Snapshot ConverterMetrics::snapshot() const {
+  Snapshot result;
+  result.frames = _frames.load(std::memory_order_relaxed);
+  result.errors = _errors.load(std::memory_order_relaxed);
+  result.bytes_in = _bytes_in.load(std::memory_order_relaxed);
+  result.bytes_out = _bytes_out.load(std::memory_order_relaxed);
+  result.total_nanoseconds = _total_nanoseconds.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < buckets; ++i) {
+    result.histogram[i] = _histogram[i].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+void ConverterMetrics::print(std::ostream &out, const std::string &name) const {
+  Snapshot s = snapshot();
+  out << name << ": frames " << s.frames << " errors " << s.errors
+      << std::setprecision(4) << std::fixed << " ratio " << s.ratio()
+      << " mean " << s.meanMilliseconds() << "ms p50 <"
+      << s.quantileMilliseconds(0.5) << "ms p99 <"
+      << s.quantileMilliseconds(0.99) << "ms" << std::endl;
+}
+
+ConverterMetrics &ConverterMetrics::named(const std::string &name) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  auto &metrics = registry[name];
+  if (!metrics) {
+    metrics.reset(new ConverterMetrics());
+  }
+  return *metrics;
+}
+
+void ConverterMetrics::printAll(std::ostream &out) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (const auto &entry : registry) {
+    entry.second->print(out, entry.first);
+  }
+}
@@ -0,0 +1,80 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/Metrics.h                                    **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace pontoon {
+namespace utils {
+
+/**
+ * Lock-free counters for a converter: processed frames, errors, input and
+ * output bytes and a latency histogram with power of two nanosecond buckets.
+ *
+ * Converters record into process wide instances obtained via named(), tools
+ * sample them with snapshot() or dump all of them with printAll().
+ */
+class ConverterMetrics {
+public:
+  typedef std::chrono::steady_clock Clock;
+  static constexpr size_t buckets = 40;
+
+  struct Snapshot {
+    uint64_t frames = 0;
+    uint64_t errors = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t total_nanoseconds = 0;
+    std::array<uint64_t, buckets> histogram{};
+
+    /// output bytes per input byte
+    double ratio() const;
+    double meanMilliseconds() const;
+    /// upper bound of the histogram bucket holding quantile q of all frames
+    double quantileMilliseconds(double q) const;
+  };
+
+  void record(size_t bytes_in, size_t bytes_out, Clock::duration latency);
+
+  void recordError() { _errors.fetch_add(1, std::memory_order_relaxed); }
+
+  Snapshot snapshot() const;
+
+  void print(std::ostream &out, const std::string &name) const;
+
+  /// the process wide instance for name, created on first use
+  static ConverterMetrics &named(const std::string &name);
+
+  static void printAll(std::ostream &out);
+
+private:
+  std::atomic<uint64_t> _frames{0};
+  std::atomic<uint64_t> _errors{0};
+  std::atomic<uint64_t> _bytes_in{0};
+  std::atomic<uint64_t> _bytes_out{0};
+  std::atomic<uint64_t> _total_nanoseconds{0};
+  std::array<std::atomic<uint64_t>, buckets> _histogram{};
+};
+
+} // namespace utils
+} // namespace pontoon
@@ -0,0 +1,183 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/OrderedWorkerPool.h                          **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include "utils/OverflowPolicy.h"
+#include "utils/SynchronizedQueue.h"
+#include <boost/noncopyable.hpp>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pontoon {
+namespace utils {
+
+/**
+ * Processes submitted inputs concurrently on a set of worker threads and
+ * hands the results to a sink strictly in submission order.
+ *
+ * At most window inputs may be in flight (submitted but not yet passed to the
+ * sink). When the window is full, submit either drops the input
+ * (drop_newest) or waits for a free slot (block_producer). Results that
+ * finish early are held back until all of their predecessors are done. An
+ * input whose work throws is skipped without stalling its successors, errors
+ * of the sink are logged as well.
+ *
+ * The sink is never called concurrently, it runs on whichever worker
+ * completes the oldest outstanding input.
+ */
+template <typename Input, typename Output>
+class OrderedWorkerPool : public boost::noncopyable {
+public:
+  typedef std::function<Output(Input)> Work;
+  typedef std::function<void(Output)> Sink;
+
+  OrderedWorkerPool(size_t threads, size_t window, Work work, Sink sink,
+                    OverflowPolicy::Type overflow = OverflowPolicy::drop_newest)
+      : _work(work), _sink(sink), _window(std::max<size_t>(window, 1)),
+        _overflow(overflow) {
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+      _workers.emplace_back([this]() { this->run(); });
+    }
+  }
+
+  ~OrderedWorkerPool() {
+    {
+      Lock lock(_mutex);
+      _closed = true;
+      _window_free.notify_all();
+    }
+    _jobs.close();
+    for (auto &worker : _workers) {
+      worker.join();
+    }
+  }
+
+  /// returns false when input was dropped because the window is full
+  bool submit(Input input) {
+    Lock lock(_mutex);
+    if (_overflow == OverflowPolicy::block_producer) {
+      _window_free.wait(lock, [this]() { return _closed || !window_full(); });
+    }
+    if (_closed || window_full()) {
+      ++_dropped;
+      return false;
+    }
+    size_t sequence = _next_submit++;
+    lock.unlock();
+    _jobs.emplace(sequence, std::move(input));
+    return true;
+  }
+
+  size_t threads() const { return _workers.size(); }
+
+  size_t in_flight() const {
+    Lock lock(_mutex);
+    return _next_submit - _next_emit;
+  }
+
+  size_t dropped() const {
+    Lock lock(_mutex);
+    return _dropped;
+  }
+
+private:
+  typedef std::mutex Mutex;
+  typedef std::unique_lock<Mutex> Lock;
+
+  struct Job {
+    size_t sequence = 0;
+    Input input;
+
+    Job() = default;
+    Job(size_t s, Input i) : sequence(s), input(std::move(i)) {}
+  };
+
+  bool window_full() const { return _next_submit - _next_emit >= _window; }
+
+  void run() {
+    Job job;
+    while (_jobs.pop(job)) {
+      std::unique_ptr<Output> result;
+      try {
+        result.reset(new Output(_work(std::move(job.input))));
+      } catch (const std::exception &e) {
+        std::cerr << "Skipping job #" << job.sequence << ": " << e.what()
+                  << std::endl;
+      }
+      finish(job.sequence, std::move(result));
+    }
+  }
+
+  void finish(size_t sequence, std::unique_ptr<Output> result) {
+    Lock lock(_mutex);
+    _done[sequence] = std::move(result);
+    if (_emitting) {
+      // the emitting worker will pick this result up
+      return;
+    }
+    _emitting = true;
+    while (!_done.empty() && _done.begin()->first == _next_emit) {
+      std::unique_ptr<Output> next = std::move(_done.begin()->second);
+      _done.erase(_done.begin());
+      const size_t emitted = _next_emit++;
+      _window_free.notify_one();
+      lock.unlock();
+      if (next) {
+        // an escaping exception would terminate the worker and leave
+        // _emitting set, which stalls all later results
+        try {
+          _sink(std::move(*next));
+        } catch (const std::exception &e) {
+          std::cerr << "Error in sink of job #" << emitted << ": "
+                    << e.what() << std::endl;
+        } catch (...) {
+          std::cerr << "Unknown error in sink of job #" << emitted
+                    << std::endl;
+        }
+      }
+      lock.lock();
+    }
+    _emitting = false;
+  }
+
+  Work _work;
+  Sink _sink;
+  const size_t _window;
+  const OverflowPolicy::Type _overflow;
+
+  mutable Mutex _mutex;
+  std::condition_variable _window_free;
+  size_t _next_submit = 0;
+  size_t _next_emit = 0;
+  size_t _dropped = 0;
+  bool _emitting = false;
+  bool _closed = false;
+  std::map<size_t, std::unique_ptr<Output>> _done;
+
+  SynchronizedQueue<Job> _jobs;
+  std::vector<std::thread> _workers;
+};
+
+} // namespace utils
+} // namespace pontoon
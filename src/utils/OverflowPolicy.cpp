@@ -0,0 +1,51 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/OverflowPolicy.cpp                           **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "utils/OverflowPolicy.h"
+#include "utils/Exception.h"
+#include <sstream>
+
+using pontoon::utils::OverflowPolicy;
+
+std::string OverflowPolicy::typeToString(OverflowPolicy::Type t) {
+  switch (t) {
+  case Type::drop_oldest:
+    return "drop-oldest";
+  case Type::drop_newest:
+    return "drop-newest";
+  case Type::block_producer:
+    return "block-producer";
+  case Type::keep_latest_per_key:
+    return "keep-latest-per-key";
+  default:
+    std::stringstream error;
+    error << "Unknown OverflowPolicy::Type (" << t << ").";
+    throw Exception(error.str());
+  }
+}
+
+OverflowPolicy::Type OverflowPolicy::stringToType(const std::string &type) {
+  if (type == "drop-oldest")
+    return Type::drop_oldest;
+  if (type == "drop-newest")
+    return Type::drop_newest;
+  if (type == "block-producer")
+    return Type::block_producer;
+  if (type == "keep-latest-per-key")
+    return Type::keep_latest_per_key;
+  throw Exception(std::string("Unknown OverflowPolicy::Type: ") + type);
+}
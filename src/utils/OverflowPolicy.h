@@ -0,0 +1,46 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/OverflowPolicy.h                             **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include <string>
+
+namespace pontoon {
+namespace utils {
+
+/**
+ * What a bounded queue does when a new element arrives while it is full.
+ */
+struct OverflowPolicy {
+
+  enum Type {
+    /// remove the oldest queued element to make room for the new one
+    drop_oldest,
+    /// reject the new element and keep the queue as it is
+    drop_newest,
+    /// let the producer wait for free space, drop the new element on timeout
+    block_producer,
+    /// keep the latest elements of each key, drop the oldest of the same key
+    keep_latest_per_key,
+  };
+
+  static std::string typeToString(Type t);
+  static Type stringToType(const std::string &type);
+};
+
+} // namespace utils
+} // namespace pontoon
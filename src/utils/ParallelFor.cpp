@@ -0,0 +1,103 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/ParallelFor.cpp                              **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#include "utils/ParallelFor.h"
+#include <algorithm>
+
+using pontoon::utils::ParallelFor;
+
+ParallelFor::ParallelFor(size_t threads) {
+  for (size_t i = 1; i < std::max<size_t>(threads, 1); ++i) {
+    _workers.emplace_back([this, i]() { this->work(i); });
+  }
+}
+
+ParallelFor::~ParallelFor() {
+  {
+    Lock lock(_mutex);
+    _closed = true;
+    _started.notify_all();
+  }
+  for (auto &worker : _workers) {
+    worker.join();
+  }
+}
+
+void ParallelFor::run(size_t count, const Task &task) {
+  if (_workers.empty() || count <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      task(i, 0);
+    }
+    return;
+  }
+  {
+    Lock lock(_mutex);
+    _task = &task;
+    _count = count;
+    _next = 0;
+    _error = nullptr;
+    ++_batch;
+    _started.notify_all();
+  }
+  drain(0);
+  Lock lock(_mutex);
+  _finished.wait(lock, [this]() { return _next >= _count && _busy == 0; });
+  _task = nullptr;
+  if (_error) {
+    std::rethrow_exception(_error);
+  }
+}
+
+void ParallelFor::work(size_t thread) {
+  size_t batch = 0;
+  while (true) {
+    {
+      Lock lock(_mutex);
+      _started.wait(lock,
+                    [this, batch]() { return _closed || _batch != batch; });
+      if (_closed) {
+        return;
+      }
+      batch = _batch;
+    }
+    drain(thread);
+  }
+}
+
+void ParallelFor::drain(size_t thread) {
+  Lock lock(_mutex);
+  while (_task && _next < _count) {
+    size_t index = _next++;
+    const Task &task = *_task;
+    ++_busy;
+    lock.unlock();
+    try {
+      task(index, thread);
+    } catch (...) {
+      lock.lock();
+      if (!_error) {
+        _error = std::current_exception();
+      }
+      lock.unlock();
+    }
+    lock.lock();
+    --_busy;
+  }
+  if (_busy == 0) {
+    _finished.notify_all();
+  }
+}
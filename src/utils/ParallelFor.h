@@ -0,0 +1,74 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/ParallelFor.h                                **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pontoon {
+namespace utils {
+
+/**
+ * Runs a batch of tasks on a fixed set of threads and waits for all of them.
+ *
+ * The calling thread works on the batch too, so a ParallelFor with one
+ * thread never starts a worker. Each task gets its index and the index of
+ * the thread running it (0 is the caller), which lets callers keep state
+ * per thread. The first exception thrown by a task is rethrown by run after
+ * the batch finished. run must not be called concurrently.
+ */
+class ParallelFor : public boost::noncopyable {
+public:
+  typedef std::function<void(size_t task, size_t thread)> Task;
+
+  ParallelFor(size_t threads);
+
+  ~ParallelFor();
+
+  void run(size_t count, const Task &task);
+
+  size_t threads() const { return _workers.size() + 1; }
+
+private:
+  typedef std::mutex Mutex;
+  typedef std::unique_lock<Mutex> Lock;
+
+  void work(size_t thread);
+  /// runs tasks of the current batch until none are left
+  void drain(size_t thread);
+
+  Mutex _mutex;
+  std::condition_variable _started;
+  std::condition_variable _finished;
+  const Task *_task = nullptr;
+  size_t _count = 0;
+  size_t _next = 0;
+  size_t _busy = 0;
+  size_t _batch = 0;
+  bool _closed = false;
+  std::exception_ptr _error;
+  std::vector<std::thread> _workers;
+};
+
+} // namespace utils
+} // namespace pontoon
@@ -0,0 +1,282 @@
+/********************************************************************
+**                                                                 **
+** File   : src/utils/RingBuffer.h                                 **
+** Authors: Viktor Richter                                         **
+**                                                                 **
+**                                                                 **
+** GNU LESSER GENERAL PUBLIC LICENSE                               **
+** This file may be used under the terms of the GNU Lesser General **
+** Public License version 3.0 as published by the                  **
+**                                                                 **
+** Free Software Foundation and appearing in the file LICENSE.LGPL **
+** included in the packaging of this file.  Please review the      **
+** following information to ensure the license requirements will   **
+** be met: http://www.gnu.org/licenses/lgpl-3.0.txt                **
+**                                                                 **
+********************************************************************/
+
+#pragma once
+
+#include "utils/Exception.h"
+#include "utils/OverflowPolicy.h"
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace pontoon {
+namespace utils {
+
+/**
+ * Fixed capacity lock-free queue with the surface of SynchronizedQueue.
+ *
+ * Every slot carries a sequence number that tells producers and consumers
+ * whether it may be written or read in the current lap (Vyukov's bounded
+ * queue). Producers claim slots with a plain store (single producer) or a
+ * CAS (multiple producers). The read position is always claimed with a CAS
+ * so a producer may discard the oldest element on overflow.
+ *
+ * Waiting consumers (pop, try_pop_for) spin briefly and then back off with
+ * growing sleeps. Producers only wait when they discarded the oldest element
+ * but a consumer still holds a cell in front of it.
+ */
+template <typename Data, bool MultiProducer = false> class RingBuffer {
+public:
+  typedef Data DataType;
+  typedef std::chrono::milliseconds Milliseconds;
+  typedef std::chrono::steady_clock Clock;
+
+  RingBuffer(size_t capacity,
+             OverflowPolicy::Type policy = OverflowPolicy::drop_oldest)
+      : _capacity(capacity), _policy(policy) {
+    if (capacity < 2) {
+      throw Exception("RingBuffer needs a capacity of at least 2.");
+    }
+    if (policy != OverflowPolicy::drop_oldest &&
+        policy != OverflowPolicy::drop_newest) {
+      throw Exception("RingBuffer does not support the overflow policy " +
+                      OverflowPolicy::typeToString(policy) + ".");
+    }
+    _cells.reset(new Cell[capacity]);
+    for (size_t i = 0; i < capacity; ++i) {
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  RingBuffer(const RingBuffer &) = delete;
+  RingBuffer &operator=(const RingBuffer &) = delete;
+
+  ~RingBuffer() {
+    close();
+    while (discard_one()) {
+    }
+  }
+
+  /// stops waiting consumers, pop returns false once the buffer is drained
+  void close() { _exit.store(true); }
+
+  /// returns false when the element was dropped because of the policy
+  bool push(Data const &data) { return emplace(data); }
+
+  bool push(Data &&data) { return emplace(std::move(data)); }
+
+  template <typename... Args> bool emplace(Args &&... args) {
+    Backoff backoff;
+    // write position when this push discarded, max while it did not
+    size_t discarded_at = std::numeric_limits<size_t>::max();
+    for (;;) {
+      Cell *cell = claim_write();
+      if (cell != nullptr) {
+        new (&cell->storage) Data(std::forward<Args>(args)...);
+        release_write(cell);
+        return true;
+      }
+      // full, args were not touched yet
+      if (_policy == OverflowPolicy::drop_newest) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      // discard once per push. The freed cell only becomes writable after
+      // consumers released all cells before it, discarding more would not
+      // speed that up. Another producer may take the freed cell though.
+      const size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+      if (discarded_at != pos && discard_one()) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        discarded_at = pos;
+      } else {
+        backoff.wait();
+      }
+    }
+  }
+
+  bool empty() const { return size() == 0; }
+
+  /// approximate while producers or consumers are active
+  size_t size() const {
+    size_t enqueued = _enqueue_pos.load(std::memory_order_acquire);
+    size_t dequeued = _dequeue_pos.load(std::memory_order_acquire);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+  }
+
+  size_t capacity() const { return _capacity; }
+
+  size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+  bool try_pop(Data &popped_value) {
+    Cell *cell = claim_read();
+    if (cell == nullptr) {
+      return false;
+    }
+    popped_value = std::move(*cell->data());
+    release_read(cell);
+    return true;
+  }
+
+  bool try_pop_for(Data &popped_value, const Milliseconds &duration) {
+    auto until = Clock::now() + duration;
+    Backoff backoff;
+    while (!try_pop(popped_value)) {
+      if (_exit.load(std::memory_order_relaxed) || Clock::now() >= until) {
+        return false;
+      }
+      backoff.wait();
+    }
+    return true;
+  }
+
+  bool pop(Data &data) {
+    Backoff backoff;
+    while (!try_pop(data)) {
+      if (_exit.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      backoff.wait();
+    }
+    return true;
+  }
+
+  /// moves all available elements to the end of dst, returns their number
+  size_t pop_all(std::vector<Data> &dst) {
+    return pop_up_to(dst, std::numeric_limits<size_t>::max());
+  }
+
+  /// moves at most n available elements to the end of dst without waiting
+  size_t pop_up_to(std::vector<Data> &dst, size_t n) {
+    size_t count = 0;
+    Cell *cell = nullptr;
+    while (count < n && (cell = claim_read()) != nullptr) {
+      dst.push_back(std::move(*cell->data()));
+      release_read(cell);
+      ++count;
+    }
+    return count;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    typename std::aligned_storage<sizeof(Data), alignof(Data)>::type storage;
+
+    Data *data() { return reinterpret_cast<Data *>(&storage); }
+  };
+
+  class Backoff {
+  public:
+    void wait() {
+      if (_rounds < 64) {
+        ++_rounds;
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(_sleep);
+        if (_sleep < std::chrono::microseconds(1000)) {
+          _sleep *= 2;
+        }
+      }
+    }
+
+  private:
+    size_t _rounds = 0;
+    std::chrono::microseconds _sleep{10};
+  };
+
+  Cell *claim_write() {
+    size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell *cell = &_cells[pos % _capacity];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+      if (diff == 0) {
+        if (!MultiProducer) {
+          _enqueue_pos.store(pos + 1, std::memory_order_relaxed);
+          return cell;
+        } else if (_enqueue_pos.compare_exchange_weak(
+                       pos, pos + 1, std::memory_order_relaxed)) {
+          return cell;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = _enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void release_write(Cell *cell) {
+    // sequence equals the claimed position, readers wait for position + 1
+    size_t sequence = cell->sequence.load(std::memory_order_relaxed);
+    cell->sequence.store(sequence + 1, std::memory_order_release);
+  }
+
+  Cell *claim_read() {
+    size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell *cell = &_cells[pos % _capacity];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff =
+          (std::ptrdiff_t)sequence - (std::ptrdiff_t)(pos + 1);
+      if (diff == 0) {
+        if (_dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          return cell;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = _dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void release_read(Cell *cell) {
+    cell->data()->~Data();
+    // sequence is pos + 1 here, the next writer expects pos + capacity
+    size_t sequence = cell->sequence.load(std::memory_order_relaxed);
+    cell->sequence.store(sequence - 1 + _capacity, std::memory_order_release);
+  }
+
+  bool discard_one() {
+    Cell *cell = claim_read();
+    if (cell == nullptr) {
+      return false;
+    }
+    release_read(cell);
+    return true;
+  }
+
+  const size_t _capacity;
+  const OverflowPolicy::Type _policy;
+  std::unique_ptr<Cell[]> _cells;
+  alignas(64) std::atomic<size_t> _enqueue_pos{0};
+  alignas(64) std::atomic<size_t> _dequeue_pos{0};
+  alignas(64) std::atomic<size_t> _dropped{0};
+  std::atomic<bool> _exit{false};
+};
+
+template <typename Data> using SpscRingBuffer = RingBuffer<Data, false>;
+template <typename Data> using MpscRingBuffer = RingBuffer<Data, true>;
+
+} // namespace utils
+} // namespace pontoon
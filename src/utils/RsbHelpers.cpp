@@ -252,11 +252,34 @@ rsb::Scope pontoon::utils::rsbhelpers::parseScope(const std::string &uri) {
   return rsb::Scope(parsed.path());
 }
 
+std::string pontoon::utils::rsbhelpers::parseScheme(const std::string &uri) {
+  return rsc::misc::uri(uri).scheme();
+}
+
+std::map<std::string, std::string>
+pontoon::utils::rsbhelpers::parseOptions(const std::string &uri) {
+  rsc::misc::uri parsed(uri);
+  std::map<std::string, std::string> options;
+  for (auto it = parsed.query.begin(), end = parsed.query.end(); it != end;
+       ++it) {
+    options[it->first] = boost::any_cast<std::string>(it->second);
+  }
+  return options;
+}
+
 rsb::ParticipantConfig
 pontoon::utils::rsbhelpers::parseConfig(const std::string &uri,
                                         rsb::ParticipantConfig config) {
   rsc::misc::uri parsed(uri);
-  if (parsed.scheme() == "") {
+  std::string scheme = parsed.scheme();
+  if (scheme == "shm") {
+    // frames go through shared memory, only their descriptors need rsb
+    scheme = parsed.query.get("transport", std::string());
+    for (auto option : {"transport", "slots", "slot_size", "lease_timeout"}) {
+      parsed.query.erase(option);
+    }
+  }
+  if (scheme == "") {
     return config;
   } else {
     rsb::ParticipantConfig updated = config;
@@ -268,7 +291,7 @@ pontoon::utils::rsbhelpers::parseConfig(const std::string &uri,
       transport.setEnabled(false);
     }
     rsb::ParticipantConfig::Transport &transport =
-        updated.mutableTransport(parsed.scheme());
+        updated.mutableTransport(scheme);
     transport.setEnabled(true);
     rsc::runtime::Properties &options = transport.mutableOptions();
     for (auto it = parsed.query.begin(), end = parsed.query.end(); it != end;
@@ -279,6 +302,17 @@ pontoon::utils::rsbhelpers::parseConfig(const std::string &uri,
   }
 }
 
+rsb::ParticipantConfig pontoon::utils::rsbhelpers::selectConverter(
+    rsb::ParticipantConfig config, const std::string &wire_schema,
+    const std::string &data_type) {
+  for (auto transport : config.getTransports(true)) {
+    // same as converter.cpp.<wire_schema> = <data_type> in the rsb config
+    config.mutableTransport(transport.getName())
+        .handleOption({"converter", "cpp", wire_schema}, data_type);
+  }
+  return config;
+}
+
 std::tuple<rsb::Scope, rsb::ParticipantConfig>
 pontoon::utils::rsbhelpers::parseUri(const std::string &uri,
                                      rsb::ParticipantConfig config) {
@@ -22,7 +22,9 @@
 #include <rsb/Scope.h>
 #include <rsb/converter/ProtocolBufferConverter.h>
 #include <rsb/converter/Repository.h>
+#include <map>
 #include <rsc/runtime/TypeStringTools.h>
+#include <string>
 
 namespace pontoon {
 namespace utils {
@@ -58,11 +60,31 @@ void optional_push_back(VectorType &vec, const OptionalData &data) {
 
 rsb::Scope parseScope(const std::string &uri);
 
+/// the scheme of uri, empty without one
+std::string parseScheme(const std::string &uri);
+
+/// the query options of uri
+std::map<std::string, std::string> parseOptions(const std::string &uri);
+
+/**
+ * Enables only the transport named by the scheme of uri and passes the
+ * query options to it. The shm scheme (see io::rst::SharedMemoryTransport)
+ * keeps the default transports unless its transport option names one.
+ */
 rsb::ParticipantConfig
 parseConfig(const std::string &uri,
             rsb::ParticipantConfig config =
                 rsb::getFactory().getDefaultParticipantConfig());
 
+/**
+ * Makes all transports of config deserialize wire_schema into data_type.
+ * Needed when several converters share a wire schema, like the ones of
+ * rst::vision::Image and io::rst::MatConverter.
+ */
+rsb::ParticipantConfig selectConverter(rsb::ParticipantConfig config,
+                                       const std::string &wire_schema,
+                                       const std::string &data_type);
+
 std::tuple<rsb::Scope, rsb::ParticipantConfig>
 parseUri(const std::string &uri,
          rsb::ParticipantConfig config =
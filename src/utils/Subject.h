@@ -17,12 +17,117 @@
 
 #pragma once
 
+#include "utils/SynchronizedQueue.h"
 #include <boost/signals2/signal.hpp>
 #include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
 
 namespace pontoon {
 namespace utils {
 
+/**
+ * Runs a subscriber on its own thread. Notifications are queued and the
+ * queue's overflow policy decides what happens when the subscriber cannot
+ * keep up, so a slow subscriber never stalls the notifying thread.
+ */
+template <typename Data> class AsyncSubscriber : public boost::noncopyable {
+public:
+  typedef std::shared_ptr<AsyncSubscriber<Data>> Ptr;
+
+  AsyncSubscriber(std::function<void(Data)> subscriber, size_t queue_size,
+                  OverflowPolicy::Type overflow)
+      : _subscriber(subscriber), _queue(queue_size, overflow),
+        _worker([this]() { this->run(); }) {}
+
+  /// must not run on the worker thread, see stop
+  ~AsyncSubscriber() { stop(); }
+
+  void operator()(Data data) { _queue.push(std::move(data)); }
+
+  /**
+   * Finishes the queued data and joins the worker. Called from within the
+   * subscriber it only closes the queue and returns false.
+   */
+  bool stop() {
+    _queue.close();
+    if (_worker.get_id() == std::this_thread::get_id()) {
+      return false;
+    }
+    if (_worker.joinable()) {
+      _worker.join();
+    }
+    return true;
+  }
+
+  size_t dropped() const { return _queue.dropped(); }
+
+private:
+  void run() {
+    Data data;
+    while (_queue.pop(data)) {
+      try {
+        _subscriber(std::move(data));
+      } catch (const std::exception &e) {
+        std::cerr << "Error in asynchronous subscriber: " << e.what()
+                  << std::endl;
+      }
+    }
+  }
+
+  std::function<void(Data)> _subscriber;
+  SynchronizedQueue<Data> _queue;
+  std::thread _worker;
+};
+
+/**
+ * Connection of an AsyncSubscriber that owns the subscriber. Disconnecting
+ * or destroying it stops notifications, finishes the queued data and joins
+ * the worker on the calling thread. It must not be destroyed by the worker.
+ */
+template <typename Data> class AsyncConnection {
+public:
+  AsyncConnection() = default;
+  AsyncConnection(boost::signals2::connection connection,
+                  std::shared_ptr<AsyncSubscriber<Data>> subscriber)
+      : _connection(connection), _subscriber(subscriber) {}
+
+  AsyncConnection(AsyncConnection &&other)
+      : _connection(other._connection),
+        _subscriber(std::move(other._subscriber)) {
+    other._connection = boost::signals2::connection();
+  }
+
+  AsyncConnection &operator=(AsyncConnection &&other) {
+    disconnect();
+    _connection = other._connection;
+    _subscriber = std::move(other._subscriber);
+    other._connection = boost::signals2::connection();
+    return *this;
+  }
+
+  ~AsyncConnection() { disconnect(); }
+
+  void disconnect() {
+    _connection.disconnect();
+    // a notification in progress may still hold the subscriber, it only
+    // pushes to the closed queue then. Disconnected from within the
+    // subscriber, the worker is joined by the destructor.
+    if (_subscriber && _subscriber->stop()) {
+      _subscriber.reset();
+    }
+  }
+
+  bool connected() const { return _connection.connected(); }
+
+  size_t dropped() const { return _subscriber ? _subscriber->dropped() : 0; }
+
+private:
+  boost::signals2::connection _connection;
+  std::shared_ptr<AsyncSubscriber<Data>> _subscriber;
+};
+
 template <typename Data> class Subject : public boost::noncopyable {
 private:
   typedef boost::signals2::signal<void(Data)> Signal;
@@ -39,6 +144,25 @@ public:
     return _Signal.connect(subscriber);
   }
 
+  /**
+   * Like connect, but the subscriber runs on a dedicated worker thread fed
+   * through a queue of queue_size elements. The returned connection owns the
+   * worker and stops it when disconnected or destroyed.
+   */
+  AsyncConnection<Data> connect_async(
+      std::function<void(Data)> subscriber, size_t queue_size = 1,
+      OverflowPolicy::Type overflow = OverflowPolicy::drop_oldest) {
+    auto async = std::make_shared<AsyncSubscriber<Data>>(subscriber,
+                                                         queue_size, overflow);
+    std::weak_ptr<AsyncSubscriber<Data>> weak = async;
+    auto connection = _Signal.connect([weak](Data data) {
+      if (auto async = weak.lock()) {
+        (*async)(std::move(data));
+      }
+    });
+    return AsyncConnection<Data>(connection, async);
+  }
+
   void disconnect(Connection subscriber) { subscriber.disconnect(); }
 
   void notify(Data data) { _Signal(data); }
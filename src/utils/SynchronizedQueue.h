@@ -17,9 +17,15 @@
 
 #pragma once
 
+#include "utils/OverflowPolicy.h"
+#include <algorithm>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <mutex>
-#include <queue>
+#include <vector>
 
 namespace pontoon {
 namespace utils {
@@ -31,23 +37,50 @@ public:
   typedef std::condition_variable ConditionVariable;
   typedef Data DataType;
   typedef std::chrono::milliseconds Milliseconds;
+  typedef std::chrono::steady_clock Clock;
+  typedef std::function<size_t(const Data &)> KeyFunction;
 
-  SynchronizedQueue(size_t maximum_size = -1) : max_size(maximum_size) {}
+  static constexpr size_t unbounded = 0;
 
-  ~SynchronizedQueue() {
+  /**
+   * maximum_size limits the number of held elements, with
+   * keep_latest_per_key it limits the elements per key instead. A
+   * block_timeout of zero lets blocked producers wait until space is
+   * available.
+   */
+  SynchronizedQueue(size_t maximum_size = unbounded,
+                    OverflowPolicy::Type overflow = OverflowPolicy::drop_oldest,
+                    Milliseconds block_timeout = Milliseconds(0),
+                    KeyFunction key = KeyFunction())
+      : max_size(maximum_size), policy(overflow), timeout(block_timeout),
+        key_of(key) {}
+
+  ~SynchronizedQueue() { close(); }
+
+  /// wakes all waiting threads, pop returns false once the queue is drained
+  void close() {
     Lock lock(mutex);
     exit = true;
     condition.notify_all();
+    not_full.notify_all();
   }
 
-  void push(Data const &data) {
+  /// returns false when data was dropped instead of being queued
+  bool push(Data const &data) { return emplace(data); }
+
+  bool push(Data &&data) { return emplace(std::move(data)); }
+
+  template <typename... Args> bool emplace(Args &&... args) {
     Lock lock(mutex);
-    if (max_size > 0 && queue.size() > max_size) {
-      queue.pop();
+    if (!wait_for_room(lock)) {
+      ++dropped_count;
+      return false;
     }
-    queue.push(data);
+    queue.emplace_back(std::forward<Args>(args)...);
+    trim();
     lock.unlock();
     condition.notify_one();
+    return true;
   }
 
   bool empty() const {
@@ -55,48 +88,149 @@ public:
     return queue.empty();
   }
 
+  size_t size() const {
+    Lock lock(mutex);
+    return queue.size();
+  }
+
+  /// number of elements dropped because of the overflow policy
+  size_t dropped() const {
+    Lock lock(mutex);
+    return dropped_count;
+  }
+
   bool try_pop(Data &popped_value) {
     Lock lock(mutex);
     if (queue.empty()) {
       return false;
     }
-    popped_value = queue.front();
-    queue.pop();
+    popped_value = std::move(queue.front());
+    pop_front();
     return true;
   }
 
   bool try_pop_for(Data &popped_value, const Milliseconds &duration) {
-    auto until = std::chrono::system_clock::now() + duration;
+    auto until = Clock::now() + duration;
     Lock lock(mutex);
-    while (!exit && queue.empty() && std::chrono::system_clock::now() < until) {
+    while (!exit && queue.empty() && Clock::now() < until) {
       condition.wait_until(lock, until);
     }
     if (!queue.empty()) {
-      popped_value = queue.front();
-      queue.pop();
+      popped_value = std::move(queue.front());
+      pop_front();
       return true;
     } else {
       return false;
     }
   }
 
-  void pop(Data &data) {
+  bool pop(Data &data) {
     Lock lock(mutex);
     while (queue.empty()) {
       if (exit) {
-        return;
+        return false;
       }
       condition.wait(lock);
     }
-    data = queue.front();
-    queue.pop();
+    data = std::move(queue.front());
+    pop_front();
+    return true;
+  }
+
+  /// moves all queued elements to the end of dst, returns their number
+  size_t pop_all(std::vector<Data> &dst) {
+    return pop_up_to(dst, std::numeric_limits<size_t>::max());
+  }
+
+  /// moves at most n queued elements to the end of dst without waiting
+  size_t pop_up_to(std::vector<Data> &dst, size_t n) {
+    Lock lock(mutex);
+    size_t count = std::min(n, queue.size());
+    auto end = queue.begin() + count;
+    dst.insert(dst.end(), std::make_move_iterator(queue.begin()),
+               std::make_move_iterator(end));
+    queue.erase(queue.begin(), end);
+    if (count > 0 && policy == OverflowPolicy::block_producer) {
+      not_full.notify_all();
+    }
+    return count;
   }
 
 private:
-  std::queue<Data> queue;
+  void pop_front() {
+    queue.pop_front();
+    if (policy == OverflowPolicy::block_producer) {
+      not_full.notify_one();
+    }
+  }
+
+  bool full() const {
+    return max_size != unbounded && queue.size() >= max_size;
+  }
+
+  // called with the lock held before inserting, false means drop the new data
+  bool wait_for_room(Lock &lock) {
+    if (max_size == unbounded) {
+      return true;
+    }
+    switch (policy) {
+    case OverflowPolicy::drop_newest:
+      return !full();
+    case OverflowPolicy::block_producer:
+      if (timeout == Milliseconds(0)) {
+        not_full.wait(lock, [this]() { return exit || !full(); });
+      } else {
+        not_full.wait_for(lock, timeout, [this]() { return exit || !full(); });
+      }
+      return !full();
+    default:
+      return true;
+    }
+  }
+
+  // called with the lock held after inserting at the back
+  void trim() {
+    if (max_size == unbounded) {
+      return;
+    }
+    if (policy == OverflowPolicy::keep_latest_per_key && key_of) {
+      drop_oldest_of_key(key_of(queue.back()));
+    } else if (policy == OverflowPolicy::drop_oldest ||
+               policy == OverflowPolicy::keep_latest_per_key) {
+      // without a key function all elements share one key
+      while (queue.size() > max_size) {
+        queue.pop_front();
+        ++dropped_count;
+      }
+    }
+  }
+
+  void drop_oldest_of_key(size_t key) {
+    size_t count = 0;
+    auto oldest = queue.end();
+    for (auto it = queue.begin(); it != queue.end(); ++it) {
+      if (key_of(*it) == key) {
+        if (oldest == queue.end()) {
+          oldest = it;
+        }
+        ++count;
+      }
+    }
+    if (count > max_size) {
+      queue.erase(oldest);
+      ++dropped_count;
+    }
+  }
+
+  std::deque<Data> queue;
   mutable Mutex mutex;
   ConditionVariable condition;
+  ConditionVariable not_full;
   size_t max_size;
+  OverflowPolicy::Type policy;
+  Milliseconds timeout;
+  KeyFunction key_of;
+  size_t dropped_count = 0;
   bool exit = false;
 };
 